@@ -0,0 +1,219 @@
+#pragma once
+
+#include "../Project_without_Set/functions.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Benchmark measurements and the results file
+ *
+ * The results file is JSON with one measurement per line inside
+ * "measurements", so it is easy to diff and to read back line by line:
+ *
+ *   {"machine": {...},
+ *    "measurements": [
+ *   {"engine": "...", "input": "...", "runs": [ms, ...], "median": ..., ...},
+ *   ...
+ *   ]}
+ *
+ * microbench and main --scaling write the same layout, so compare reads
+ * all of them.
+ **/
+
+struct Summary {
+    double median = 0;
+    double mean = 0;
+    double stddev = 0;  // sample standard deviation
+    double min = 0;
+    double max = 0;
+};
+
+auto summarize = [](std::vector<double> values) {
+    Summary summary;
+    if (values.empty()) {
+        return summary;
+    }
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    summary.median = n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+    summary.mean = std::accumulate(values.begin(), values.end(), 0.0) / n;
+    double squares = 0;
+    for (double value : values) {
+        squares += (value - summary.mean) * (value - summary.mean);
+    }
+    summary.stddev = n > 1 ? std::sqrt(squares / (n - 1)) : 0;
+    summary.min = values.front();
+    summary.max = values.back();
+    return summary;
+};
+
+struct Measurement {
+    std::string engine;
+    std::string input;
+    std::vector<double> runs;  // wall-clock milliseconds
+    long peakRssKb = 0;
+    uint64_t outputHash = 0;
+    size_t outputBytes = 0;
+    bool identical = true;     // output.txt equals the first engine's for this input
+};
+
+// Quotes and backslashes are the only characters paths and names here need escaped
+auto jsonString = [](const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted.push_back('\\');
+        }
+        quoted.push_back(c);
+    }
+    return quoted + "\"";
+};
+
+auto measurementJson = [](const Measurement& measurement) {
+    Summary summary = summarize(measurement.runs);
+    std::string runs;
+    for (size_t i = 0; i < measurement.runs.size(); ++i) {
+        runs += (i ? ", " : "") + std::to_string(measurement.runs[i]);
+    }
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(measurement.outputHash));
+
+    return "{\"engine\": " + jsonString(measurement.engine) + ", \"input\": " + jsonString(measurement.input)
+         + ", \"runs\": [" + runs + "]"
+         + ", \"median\": " + std::to_string(summary.median) + ", \"mean\": " + std::to_string(summary.mean)
+         + ", \"stddev\": " + std::to_string(summary.stddev) + ", \"min\": " + std::to_string(summary.min)
+         + ", \"peakRssKb\": " + std::to_string(measurement.peakRssKb)
+         + ", \"outputHash\": \"" + hash + "\", \"outputBytes\": " + std::to_string(measurement.outputBytes)
+         + ", \"identical\": " + (measurement.identical ? "true" : "false") + "}";
+};
+
+auto resultsJson = [](const std::string& machineJson, const std::vector<Measurement>& measurements) {
+    std::string json = "{\"machine\": " + machineJson + ",\n \"measurements\": [";
+    for (size_t i = 0; i < measurements.size(); ++i) {
+        json += (i ? ",\n" : "\n") + measurementJson(measurements[i]);
+    }
+    return json + "\n]}\n";
+};
+
+// The string after "key": on a results line, unescaped
+auto jsonStringField = [](const std::string& line, const std::string& key) -> Maybe<std::string> {
+    auto pos = line.find("\"" + key + "\": \"");
+    if (pos == std::string::npos) {
+        return {std::nullopt};
+    }
+    std::string value;
+    for (size_t i = pos + key.size() + 5; i < line.size(); ++i) {
+        if (line[i] == '\\' && i + 1 < line.size()) {
+            value.push_back(line[++i]);
+        } else if (line[i] == '"') {
+            return {value};
+        } else {
+            value.push_back(line[i]);
+        }
+    }
+    return {std::nullopt};
+};
+
+// engine, input and runs of one measurement line; the other fields are recomputed from the runs
+auto parseMeasurement = [](const std::string& line) -> Maybe<Measurement> {
+    auto engine = jsonStringField(line, "engine");
+    auto input = jsonStringField(line, "input");
+    auto runsAt = line.find("\"runs\": [");
+    if (!engine.valueType.has_value() || !input.valueType.has_value() || runsAt == std::string::npos) {
+        return {std::nullopt};
+    }
+    Measurement measurement;
+    measurement.engine = engine.valueType.value();
+    measurement.input = input.valueType.value();
+    const char* cursor = line.c_str() + runsAt + 9;
+    while (*cursor != ']' && *cursor != '\0') {
+        char* next = nullptr;
+        double value = std::strtod(cursor, &next);
+        if (next == cursor) {
+            return {std::nullopt};
+        }
+        measurement.runs.push_back(value);
+        cursor = next;
+        while (*cursor == ',' || *cursor == ' ') {
+            ++cursor;
+        }
+    }
+    return {measurement};
+};
+
+auto readResults = [](const std::string& path) -> Maybe<std::vector<Measurement>> {
+    auto text = readFileIntoString(path);
+    if (!text.valueType.has_value()) {
+        return {std::nullopt};
+    }
+    std::vector<Measurement> measurements;
+    std::istringstream lines(text.valueType.value());
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.rfind("{\"engine\"", 0) != 0) {
+            continue;
+        }
+        auto measurement = parseMeasurement(line);
+        if (!measurement.valueType.has_value()) {
+            return {std::nullopt};
+        }
+        measurements.push_back(measurement.valueType.value());
+    }
+    return {measurements};
+};
+
+struct Change {
+    double estimate = 0;  // candidate median / baseline median - 1
+    double low = 0;       // confidence interval of the estimate
+    double high = 0;
+};
+
+// Percentile bootstrap of the ratio of medians: runs are skewed and few, so
+// no normal distribution is assumed. The seed makes every comparison repeatable.
+auto relativeChange = [](const std::vector<double>& baseline, const std::vector<double>& candidate,
+                         double confidence = 0.95, int resamples = 10000) {
+    Change change;
+    if (baseline.empty() || candidate.empty()) {
+        return change;
+    }
+    change.estimate = summarize(candidate).median / summarize(baseline).median - 1;
+
+    std::mt19937_64 engine(1);
+    auto resample = [&engine](const std::vector<double>& runs) {
+        std::vector<double> drawn(runs.size());
+        for (double& value : drawn) {
+            value = runs[engine() % runs.size()];
+        }
+        return summarize(drawn).median;
+    };
+    std::vector<double> ratios(resamples);
+    for (double& ratio : ratios) {
+        double base = resample(baseline);
+        ratio = resample(candidate) / base - 1;
+    }
+    std::sort(ratios.begin(), ratios.end());
+    auto at = [&ratios](double p) {
+        return ratios[std::min(ratios.size() - 1, static_cast<size_t>(p * ratios.size()))];
+    };
+    change.low = at((1 - confidence) / 2);
+    change.high = at((1 + confidence) / 2);
+    return change;
+};
+
+enum class Verdict { Same, Faster, Slower, Regression };
+
+// Lower is better in every results file. A change counts once the interval
+// excludes 0; a slowdown past threshold is a regression
+auto verdict = [](const Change& change, double threshold) {
+    if (change.low > 0) {
+        return change.estimate > threshold ? Verdict::Regression : Verdict::Slower;
+    }
+    if (change.high < 0) {
+        return Verdict::Faster;
+    }
+    return Verdict::Same;
+};
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "../Project_without_Set/functions.h"
+#include "../Project_without_Set/Zipf.h"
+#include <cstdio>
+#include <functional>
+#include <numeric>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Synthetic books for scale testing
+ *
+ * A book is laid out like a Project Gutenberg file: a header, the START line,
+ * the title, "CHAPTER 1", chapters of Zipf-distributed words in sentences,
+ * paragraphs and 72-column lines, and the END line, so both projects and
+ * --corpus trim it like War and Peace. Words are drawn from a vocabulary of
+ * distinct made-up words with English letter frequencies; shorter words get
+ * the lower, more frequent ranks, as in real text. Everything comes from one
+ * seeded mt19937_64 and uses no standard distributions, whose output differs
+ * between standard libraries. The Zipf weights and word lengths still go
+ * through std::pow and std::exp, so a seed gives the same bytes for the same
+ * libm, not necessarily across platforms.
+ **/
+
+// Uniform in [0, 1) from the top 53 bits, independent of the standard library
+inline double unitInterval(uint64_t bits) {
+    return (bits >> 11) * 0x1.0p-53;
+}
+
+// Draws from the same distribution as ZipfSampler (Zipf.h), but from an alias table (Vose):
+// a draw costs one call of the engine and two lookups whatever n is
+class AliasZipfSampler {
+public:
+    AliasZipfSampler(size_t n, double exponent = 1.0) : _threshold(n), _alias(n) {
+        std::vector<double> scaled(n);
+        double total = 0;
+        for (size_t r = 0; r < n; ++r) {
+            scaled[r] = 1.0 / std::pow(static_cast<double>(r + 1), exponent);
+            total += scaled[r];
+        }
+        std::vector<uint32_t> small, large;
+        for (size_t r = 0; r < n; ++r) {
+            scaled[r] *= n / total;
+            (scaled[r] < 1.0 ? small : large).push_back(r);
+        }
+        // Every column is filled up to 1 by its own rank and one larger one
+        while (!small.empty() && !large.empty()) {
+            uint32_t less = small.back(), more = large.back();
+            small.pop_back();
+            _threshold[less] = scaled[less];
+            _alias[less] = more;
+            scaled[more] -= 1.0 - scaled[less];
+            if (scaled[more] < 1.0) {
+                large.pop_back();
+                small.push_back(more);
+            }
+        }
+        for (auto* rest : {&small, &large}) {
+            for (uint32_t r : *rest) {
+                _threshold[r] = 1.0;
+                _alias[r] = r;
+            }
+        }
+    }
+
+    // High 32 bits pick the column, low 32 bits the side
+    template<class Engine>
+    size_t operator()(Engine& engine) const {
+        uint64_t bits = engine();
+        size_t column = ((bits >> 32) * _threshold.size()) >> 32;
+        double u = (bits & 0xffffffff) * 0x1.0p-32;
+        return u < _threshold[column] ? column : _alias[column];
+    }
+
+    size_t size() const {
+        return _threshold.size();
+    }
+
+private:
+    std::vector<double> _threshold;
+    std::vector<uint32_t> _alias;
+};
+
+struct CorpusOptions {
+    uint64_t bytes = 3 << 20;           // of the whole file, header included
+    size_t vocabulary = 20000;          // distinct words to draw from
+    double exponent = 1.0;              // of the Zipf distribution
+    double meanLength = 7.0;            // letters per vocabulary word
+    size_t maxLength = 20;
+    double apostrophes = 0.01;          // fraction of words like "wouldn't"
+    double hyphens = 0.02;              // fraction of words like "well-known"
+    size_t chapterWords = 5000;
+    std::string title = "WAR AND PEACE";
+    uint64_t seed = 1;
+};
+
+struct CorpusStats {
+    uint64_t words = 0;
+    uint64_t bytes = 0;
+    size_t distinct = 0;                // vocabulary words that were used
+};
+
+// Per mille in English text; rounding leaves the sum a little off 1000
+constexpr int LETTER_FREQUENCIES[26] = {82, 15, 28, 43, 127, 22, 20, 61, 70, 2, 8, 40, 24,
+                                        67, 75, 19, 1, 60, 63, 91, 28, 10, 24, 2, 20, 1};
+constexpr int LETTER_TOTAL = std::accumulate(std::begin(LETTER_FREQUENCIES), std::end(LETTER_FREQUENCIES), 0);
+
+inline char randomLetter(std::mt19937_64& engine) {
+    int pick = static_cast<int>(unitInterval(engine()) * LETTER_TOTAL);
+    for (int i = 0; i < 26; ++i) {
+        pick -= LETTER_FREQUENCIES[i];
+        if (pick < 0) {
+            return 'a' + i;
+        }
+    }
+    return 'e';
+}
+
+// 2 + Poisson(mean - 2), cut off at maxLength
+inline size_t randomLength(std::mt19937_64& engine, double mean, size_t maxLength) {
+    double limit = std::exp(-std::max(mean - 2.0, 0.0));
+    double product = unitInterval(engine());
+    size_t length = 2;
+    while (product > limit && length < maxLength) {
+        product *= unitInterval(engine());
+        ++length;
+    }
+    return length;
+}
+
+auto makeVocabulary = [](const CorpusOptions& options) {
+    std::mt19937_64 engine(options.seed);
+    std::unordered_set<std::string> seen;
+    std::vector<std::string> words;
+    words.reserve(options.vocabulary);
+    while (words.size() < options.vocabulary) {
+        size_t length = randomLength(engine, options.meanLength, options.maxLength);
+        std::string word;
+        // Short lengths run out of words, so a word that exists already gets one more letter
+        do {
+            word.clear();
+            for (size_t i = 0; i < length; ++i) {
+                word.push_back(randomLetter(engine));
+            }
+            double decoration = unitInterval(engine());
+            if (length >= 3 && decoration < options.apostrophes) {
+                word.insert(word.size() - 1, 1, '\'');
+            } else if (length >= 4 && decoration < options.apostrophes + options.hyphens) {
+                word.insert(2 + engine() % (length - 3), 1, '-');
+            }
+            ++length;
+        } while (!seen.insert(word).second);
+        words.push_back(std::move(word));
+    }
+    std::stable_sort(words.begin(), words.end(), [](const auto& a, const auto& b) { return a.size() < b.size(); });
+    return words;
+};
+
+// Wraps lines at 72 columns and hands the text on in blocks of about 1 MiB
+class BookWriter {
+public:
+    explicit BookWriter(std::function<void(const std::string&)> sink) : _sink(std::move(sink)) {}
+
+    void word(const std::string& text) {
+        if (_column > 0 && _column + 1 + text.size() > 72) {
+            newline();
+        } else if (_column > 0) {
+            _buffer.push_back(' ');
+            ++_column;
+        }
+        _buffer += text;
+        _column += text.size();
+        flushIfFull();
+    }
+
+    void line(const std::string& text) {
+        if (_column > 0) {
+            newline();
+        }
+        _buffer += text;
+        newline();
+    }
+
+    void newline() {
+        _buffer.push_back('\n');
+        _column = 0;
+        flushIfFull();
+    }
+
+    void flush() {
+        _bytes += _buffer.size();
+        _sink(_buffer);
+        _buffer.clear();
+    }
+
+    uint64_t bytes() const {
+        return _bytes + _buffer.size();
+    }
+
+private:
+    std::function<void(const std::string&)> _sink;
+    std::string _buffer;
+    size_t _column = 0;
+    uint64_t _bytes = 0;
+
+    void flushIfFull() {
+        if (_buffer.size() >= (1 << 20)) {
+            flush();
+        }
+    }
+};
+
+// Writes one book to sink; vocabulary is makeVocabulary(options) or shared by several books
+auto generateBook = [](const CorpusOptions& options, const std::vector<std::string>& vocabulary) {
+    return [&options, &vocabulary](std::function<void(const std::string&)> sink) {
+        std::mt19937_64 engine(splitmix64(options.seed));
+        AliasZipfSampler sampler(vocabulary.size(), options.exponent);
+        std::vector<bool> used(vocabulary.size());
+        CorpusStats stats;
+        BookWriter writer(std::move(sink));
+
+        std::string endLine = "*** END OF THE PROJECT GUTENBERG EBOOK, " + options.title + " ***";
+        writer.line("The Project Gutenberg EBook of " + options.title + ", synthetic corpus " + std::to_string(options.seed));
+        writer.newline();
+        writer.line("*** START OF THE PROJECT GUTENBERG EBOOK, " + options.title + " ***");
+        writer.newline();
+        writer.line(options.title);
+        writer.newline();
+
+        uint64_t body = options.bytes > endLine.size() + 2 ? options.bytes - endLine.size() - 2 : 0;
+        size_t chapter = 0;
+        size_t chapterLeft = 0;
+        while (writer.bytes() < body) {
+            if (chapterLeft == 0) {
+                writer.newline();
+                writer.line("CHAPTER " + std::to_string(++chapter));
+                writer.newline();
+                chapterLeft = options.chapterWords;
+            }
+            // A paragraph of 3 to 8 sentences of 5 to 24 words
+            size_t sentences = 3 + engine() % 6;
+            for (size_t s = 0; s < sentences && chapterLeft > 0 && writer.bytes() < body; ++s) {
+                size_t length = 5 + engine() % 20;
+                for (size_t w = 0; w < length; ++w) {
+                    size_t rank = sampler(engine);
+                    used[rank] = true;
+                    std::string word = vocabulary[rank];
+                    if (w == 0) {
+                        word[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(word[0])));
+                    }
+                    if (w + 1 == length) {
+                        word.push_back('.');
+                    } else if (engine() % 10 == 0) {
+                        word.push_back(',');
+                    }
+                    writer.word(word);
+                }
+                stats.words += length;
+                chapterLeft -= std::min(chapterLeft, length);
+            }
+            writer.newline();
+            writer.newline();
+        }
+
+        writer.line(endLine);
+        writer.flush();
+        stats.bytes = writer.bytes();
+        stats.distinct = std::count(used.begin(), used.end(), true);
+        return stats;
+    };
+};
+
+// "3M", "10G", "512K" or plain bytes
+auto parseSize = [](const std::string& text) -> Maybe<uint64_t> {
+    size_t end = 0;
+    uint64_t value = 0;
+    try {
+        value = std::stoull(text, &end);
+    } catch (const std::exception&) {
+        return {std::nullopt};
+    }
+    std::string suffix = text.substr(end);
+    if (suffix.empty()) {
+        return {value};
+    }
+    if (suffix.size() == 1 && std::string("KkMmGg").find(suffix[0]) != std::string::npos) {
+        int shift = std::toupper(suffix[0]) == 'K' ? 10 : std::toupper(suffix[0]) == 'M' ? 20 : 30;
+        return {value << shift};
+    }
+    return {std::nullopt};
+};
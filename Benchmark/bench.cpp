@@ -0,0 +1,220 @@
+#include "Results.h"
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+
+// bench [--engine name=program [args...]]... [--input file]... [--warmup N] [--repetitions N] [--results results.json]
+//
+// Every engine runs in a directory of its own where the input is linked as
+// war_and_peace.txt, the name both projects read. Without --engine the two
+// project variants are compared, without --input War and Peace is used.
+
+struct Engine {
+    std::string name;
+    std::vector<std::string> command;
+};
+
+struct Run {
+    double milliseconds = 0;
+    long peakRssKb = 0;
+    bool ok = false;
+};
+
+auto optionValues = [](int argc, char* argv[]) {
+    return [argc, argv](const std::string& name) {
+        std::vector<std::string> values;
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (name == argv[i]) {
+                values.emplace_back(argv[i + 1]);
+            }
+        }
+        return values;
+    };
+};
+
+// "name=program arg..." split at whitespace
+auto parseEngine = [](const std::string& spec) -> Maybe<Engine> {
+    auto equals = spec.find('=');
+    if (equals == std::string::npos || equals == 0) {
+        return {std::nullopt};
+    }
+    Engine engine{spec.substr(0, equals), {}};
+    std::istringstream words(spec.substr(equals + 1));
+    std::string word;
+    while (words >> word) {
+        engine.command.push_back(word);
+    }
+    if (engine.command.empty()) {
+        return {std::nullopt};
+    }
+    engine.command[0] = std::filesystem::absolute(engine.command[0]).string();
+    return {engine};
+};
+
+// Runs the engine in directory with its output discarded; the time includes starting the process
+auto runEngine = [](const Engine& engine) {
+    return [&engine](const std::string& directory) {
+        Run run;
+        auto start = std::chrono::steady_clock::now();
+        pid_t pid = fork();
+        if (pid < 0) {
+            return run;
+        }
+        if (pid == 0) {
+            int log = open((directory + "/log.txt").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (chdir(directory.c_str()) != 0 || log < 0) {
+                _exit(127);
+            }
+            dup2(log, STDOUT_FILENO);
+            dup2(log, STDERR_FILENO);
+            std::vector<char*> arguments;
+            for (const auto& argument : engine.command) {
+                arguments.push_back(const_cast<char*>(argument.c_str()));
+            }
+            arguments.push_back(nullptr);
+            execv(arguments[0], arguments.data());
+            _exit(127);
+        }
+
+        int status = 0;
+        rusage usage{};
+        wait4(pid, &status, 0, &usage);
+        run.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        run.peakRssKb = usage.ru_maxrss;
+        run.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        return run;
+    };
+};
+
+// A fresh directory with the input linked under the name the engines read
+auto prepareDirectory = [](const std::string& input) -> Maybe<std::string> {
+    char pattern[] = "/tmp/bench_XXXXXX";
+    if (!mkdtemp(pattern)) {
+        return {std::nullopt};
+    }
+    std::string directory = pattern;
+    std::error_code error;
+    std::filesystem::create_symlink(std::filesystem::absolute(input), directory + "/war_and_peace.txt", error);
+    if (error) {
+        return {std::nullopt};
+    }
+    return {directory};
+};
+
+inline uint64_t fileHash(const std::string& text) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : text) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+    }
+    return hash;
+}
+
+auto machineJson = []() {
+    utsname name{};
+    uname(&name);
+    std::string cpu = "unknown";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.rfind("model name", 0) == 0) {
+            cpu = line.substr(line.find(':') + 2);
+            break;
+        }
+    }
+    return "{\"cpu\": " + jsonString(cpu) + ", \"cores\": " + std::to_string(std::thread::hardware_concurrency())
+         + ", \"kernel\": " + jsonString(std::string(name.sysname) + " " + name.release) + "}";
+};
+
+auto benchmark = [](const Engine& engine) {
+    return [&engine](const std::string& input, int warmups, int repetitions) -> Maybe<Measurement> {
+        auto directory = prepareDirectory(input);
+        if (!directory.valueType.has_value()) {
+            return {std::nullopt};
+        }
+        const std::string& dir = directory.valueType.value();
+        std::string outputPath = dir + "/output.txt";
+
+        Measurement measurement;
+        measurement.engine = engine.name;
+        measurement.input = input;
+        bool ok = true;
+        for (int i = 0; i < warmups + repetitions && ok; ++i) {
+            std::remove(outputPath.c_str());
+            Run run = runEngine(engine)(dir);
+            ok = run.ok;
+            if (i >= warmups) {
+                measurement.runs.push_back(run.milliseconds);
+                measurement.peakRssKb = std::max(measurement.peakRssKb, run.peakRssKb);
+            }
+        }
+
+        std::string output = readFileIntoString(outputPath).valueType.value_or("");
+        measurement.outputHash = fileHash(output);
+        measurement.outputBytes = output.size();
+        std::filesystem::remove_all(dir);
+        if (!ok) {
+            return {std::nullopt};
+        }
+        return {measurement};
+    };
+};
+
+int main(int argc, char* argv[]) {
+    auto option = optionValue(argc, argv);
+    int warmups = std::stoi(option("--warmup").valueType.value_or("1"));
+    int repetitions = std::stoi(option("--repetitions").valueType.value_or("5"));
+    std::string resultsPath = option("--results").valueType.value_or("results.json");
+
+    std::vector<std::string> specs = optionValues(argc, argv)("--engine");
+    if (specs.empty()) {
+        specs = {"with_Set=../Project_with_Set/buildG++/main", "without_Set=../Project_without_Set/buildG++/main"};
+    }
+    std::vector<std::string> inputs = optionValues(argc, argv)("--input");
+    if (inputs.empty()) {
+        inputs = {"../Project_without_Set/war_and_peace.txt"};
+    }
+
+    std::vector<Engine> engines;
+    for (const auto& spec : specs) {
+        auto engine = parseEngine(spec);
+        if (!engine.valueType.has_value()) {
+            std::cerr << "\nInvalid engine " << spec << "\n";
+            return 1;
+        }
+        engines.push_back(engine.valueType.value());
+    }
+
+    std::vector<Measurement> measurements;
+    bool identical = true;
+    std::printf("%-16s %-28s %10s %10s %10s %10s %8s\n", "engine", "input", "median ms", "stddev", "min ms", "peak MB", "output");
+    for (const auto& input : inputs) {
+        size_t first = measurements.size();
+        for (const auto& engine : engines) {
+            auto measurement = benchmark(engine)(input, warmups, repetitions);
+            if (!measurement.valueType.has_value()) {
+                std::cerr << "\n" << engine.name << " failed on " << input << "\n";
+                return 1;
+            }
+            measurements.push_back(measurement.valueType.value());
+            Measurement& m = measurements.back();
+            m.identical = m.outputHash == measurements[first].outputHash;
+            identical = identical && m.identical;
+
+            Summary summary = summarize(m.runs);
+            std::printf("%-16s %-28s %10.1f %10.1f %10.1f %10.1f %8s\n", m.engine.c_str(),
+                        std::filesystem::path(input).filename().string().c_str(), summary.median, summary.stddev,
+                        summary.min, m.peakRssKb / 1024.0, m.identical ? "same" : "DIFFERS");
+        }
+    }
+
+    if (!writeBuffer(resultsJson(machineJson(), measurements))(resultsPath.c_str())) {
+        return 1;
+    }
+    if (!identical) {
+        std::cerr << "\nEngines disagree on output.txt\n";
+        return 2;
+    }
+    return 0;
+}
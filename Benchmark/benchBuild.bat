@@ -0,0 +1,8 @@
+@echo off
+
+mkdir buildG++
+pushd buildG++
+wsl g++ -std=c++20 ../bench.cpp -o bench -O2 -pthread
+wsl g++ -std=c++20 ../generate.cpp -o generate -O2
+wsl g++ -std=c++20 ../compare.cpp -o compare -O2
+popd buildG++
\ No newline at end of file
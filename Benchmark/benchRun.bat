@@ -0,0 +1,2 @@
+@echo off
+wsl ./buildG++/bench --engine with_Set=../Project_with_Set/buildG++/main --engine without_Set=../Project_without_Set/buildG++/main --input ../Project_without_Set/war_and_peace.txt --results results.json
\ No newline at end of file
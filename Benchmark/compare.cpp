@@ -0,0 +1,66 @@
+#include "Results.h"
+#include <map>
+
+// compare <baseline.json> <candidate.json> [--threshold percent] [--confidence 0.95]
+//
+// Matches the measurements of two results files by engine and input and
+// prints the change of the median with its bootstrap confidence interval.
+// Exits with 1 when a case got slower by more than --threshold percent
+// (default 5) with the whole interval above 0, so scripts can reject the
+// candidate, and with 2 when a file cannot be read.
+
+const char* VERDICT_NAMES[] = {"same", "faster", "slower", "REGRESSION"};
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "\nUsage: compare <baseline.json> <candidate.json> [--threshold percent] [--confidence 0.95]\n";
+        return 2;
+    }
+    auto option = optionValue(argc, argv);
+    double threshold = std::stod(option("--threshold").valueType.value_or("5")) / 100;
+    double confidence = std::stod(option("--confidence").valueType.value_or("0.95"));
+
+    auto baseline = readResults(argv[1]);
+    auto candidate = readResults(argv[2]);
+    if (!baseline.valueType.has_value() || !candidate.valueType.has_value()) {
+        std::cerr << "\nCould not read " << (baseline.valueType.has_value() ? argv[2] : argv[1]) << "\n";
+        return 2;
+    }
+
+    auto key = [](const Measurement& m) { return m.engine + "\t" + m.input; };
+    std::map<std::string, const Measurement*> candidates;
+    for (const auto& measurement : candidate.valueType.value()) {
+        candidates[key(measurement)] = &measurement;
+    }
+
+    int regressions = 0;
+    std::printf("%-40s %-28s %10s %10s %8s %20s  %s\n", "engine", "input", "baseline", "candidate", "change",
+                "interval", "verdict");
+    for (const auto& before : baseline.valueType.value()) {
+        auto found = candidates.find(key(before));
+        const char* input = before.input.c_str();
+        if (found == candidates.end()) {
+            std::printf("%-40s %-28s %10.1f %10s\n", before.engine.c_str(), input, summarize(before.runs).median, "missing");
+            continue;
+        }
+        const Measurement& after = *found->second;
+        candidates.erase(found);
+
+        Change change = relativeChange(before.runs, after.runs, confidence);
+        Verdict result = verdict(change, threshold);
+        regressions += result == Verdict::Regression;
+        char interval[32];
+        std::snprintf(interval, sizeof(interval), "[%+.1f%%, %+.1f%%]", 100 * change.low, 100 * change.high);
+        std::printf("%-40s %-28s %10.1f %10.1f %+7.1f%% %20s  %s\n", before.engine.c_str(), input,
+                    summarize(before.runs).median, summarize(after.runs).median, 100 * change.estimate, interval,
+                    VERDICT_NAMES[static_cast<int>(result)]);
+    }
+    for (const auto& [name, after] : candidates) {
+        std::printf("%-40s %-28s %10s %10.1f\n", after->engine.c_str(),
+                    after->input.c_str(), "new", summarize(after->runs).median);
+    }
+
+    std::printf("\n%d regression%s past %.1f%% at %.0f%% confidence\n", regressions, regressions == 1 ? "" : "s",
+                100 * threshold, 100 * confidence);
+    return regressions > 0 ? 1 : 0;
+}
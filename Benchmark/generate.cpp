@@ -0,0 +1,89 @@
+#include "Synthetic.h"
+#include <filesystem>
+
+// generate --out <file | directory> [--size 3M] [--books N] [--vocabulary N] [--exponent s]
+//          [--mean-length L] [--max-length L] [--apostrophes p] [--hyphens p]
+//          [--chapter-words N] [--title "WAR AND PEACE"] [--seed N]
+//
+// Writes a synthetic Gutenberg-shaped book of about --size bytes. With
+// --books N, --out is a directory that gets N books of --size bytes each,
+// book_0001.txt and so on, drawing on one vocabulary with seeds seed, seed + 1, ...
+
+auto numberOption = [](auto option) {
+    return [option](const std::string& name, double fallback) {
+        auto value = option(name);
+        return value.valueType.has_value() ? std::stod(value.valueType.value()) : fallback;
+    };
+};
+
+int main(int argc, char* argv[]) {
+    auto option = optionValue(argc, argv);
+    auto number = numberOption(option);
+    auto out = option("--out");
+    auto size = parseSize(option("--size").valueType.value_or("3M"));
+    if (!out.valueType.has_value() || !size.valueType.has_value()) {
+        std::cerr << "\nUsage: generate --out <file | directory> [--size 3M] [--books N] ...\n";
+        return 1;
+    }
+
+    CorpusOptions options;
+    options.bytes = size.valueType.value();
+    options.vocabulary = static_cast<size_t>(number("--vocabulary", options.vocabulary));
+    options.exponent = number("--exponent", options.exponent);
+    options.meanLength = number("--mean-length", options.meanLength);
+    options.maxLength = static_cast<size_t>(number("--max-length", options.maxLength));
+    options.apostrophes = number("--apostrophes", options.apostrophes);
+    options.hyphens = number("--hyphens", options.hyphens);
+    options.chapterWords = static_cast<size_t>(number("--chapter-words", options.chapterWords));
+    options.title = option("--title").valueType.value_or(options.title);
+    options.seed = static_cast<uint64_t>(number("--seed", options.seed));
+    size_t books = static_cast<size_t>(number("--books", 1));
+    if (options.vocabulary == 0 || options.maxLength < 2 || books == 0) {
+        std::cerr << "\nThe vocabulary, the books and --max-length must not be empty\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> vocabulary = makeVocabulary(options);
+    std::vector<std::string> paths;
+    if (books == 1) {
+        paths.push_back(out.valueType.value());
+    } else {
+        std::filesystem::create_directories(out.valueType.value());
+        for (size_t i = 1; i <= books; ++i) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/book_%04zu.txt", i);
+            paths.push_back(out.valueType.value() + name);
+        }
+    }
+
+    CorpusStats total;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        std::FILE* file = std::fopen(paths[i].c_str(), "wb");
+        if (!file) {
+            std::cerr << "\nCould not write " << paths[i] << "\n";
+            return 1;
+        }
+        CorpusOptions book = options;
+        book.seed = options.seed + i;
+        bool ok = true;
+        CorpusStats stats = generateBook(book, vocabulary)([file, &ok](const std::string& block) {
+            ok = ok && std::fwrite(block.data(), 1, block.size(), file) == block.size();
+        });
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok) {
+            std::cerr << "\nCould not write " << paths[i] << "\n";
+            return 1;
+        }
+        total.words += stats.words;
+        total.bytes += stats.bytes;
+        std::printf("%s: %llu bytes, %llu words, %zu distinct (%.3f%%)\n", paths[i].c_str(),
+                    static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.words),
+                    stats.distinct, 100.0 * stats.distinct / std::max<uint64_t>(stats.words, 1));
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%zu books, %llu bytes, vocabulary %zu, %.1f MB/s\n", paths.size(),
+                static_cast<unsigned long long>(total.bytes), vocabulary.size(), total.bytes / 1e6 / seconds);
+    return 0;
+}
@@ -0,0 +1,168 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../Project_without_Set/doctest.h"
+#include "Results.h"
+#include "Synthetic.h"
+
+TEST_CASE("Test summarize function") {
+    SUBCASE("Odd number of runs") {
+        Summary summary = summarize({30, 10, 20});
+        CHECK(summary.median == 20);
+        CHECK(summary.mean == 20);
+        CHECK(summary.stddev == doctest::Approx(10));
+        CHECK(summary.min == 10);
+        CHECK(summary.max == 30);
+    }
+
+    SUBCASE("Even number of runs") {
+        Summary summary = summarize({4, 1, 3, 2});
+        CHECK(summary.median == 2.5);
+    }
+
+    SUBCASE("Single and no runs") {
+        CHECK(summarize({7}).stddev == 0);
+        CHECK(summarize({}).median == 0);
+    }
+}
+
+TEST_CASE("Test results file") {
+    Measurement measurement{"with_Set", "books/\"odd\".txt", {12.5, 10}, 2048, 255, 100, false};
+    std::string json = measurementJson(measurement);
+    CHECK(json.find("\"engine\": \"with_Set\"") != std::string::npos);
+    CHECK(json.find("\"input\": \"books/\\\"odd\\\".txt\"") != std::string::npos);
+    CHECK(json.find("\"runs\": [12.500000, 10.000000]") != std::string::npos);
+    CHECK(json.find("\"outputHash\": \"00000000000000ff\"") != std::string::npos);
+    CHECK(json.find("\"identical\": false") != std::string::npos);
+
+    std::string results = resultsJson("{}", {measurement, measurement});
+    CHECK(std::count(results.begin(), results.end(), '\n') == 5);
+}
+
+TEST_CASE("Test comparing results") {
+    SUBCASE("Measurement lines are read back") {
+        Measurement measurement{"stream", "books/\"odd\".txt", {12.5, 10, 11.25}, 2048, 255, 100, true};
+        std::string json = resultsJson("{}", {measurement, Measurement{"other", "a.txt", {1}}});
+        std::string path = "compare_test.json";
+        REQUIRE(writeBuffer(json)(path.c_str()));
+        auto measurements = readResults(path);
+        std::remove(path.c_str());
+        REQUIRE(measurements.valueType.has_value());
+        REQUIRE(measurements.valueType.value().size() == 2);
+        const Measurement& read = measurements.valueType.value()[0];
+        CHECK(read.engine == "stream");
+        CHECK(read.input == "books/\"odd\".txt");
+        CHECK(read.runs == std::vector<double>{12.5, 10, 11.25});
+        CHECK_FALSE(parseMeasurement("{\"engine\": \"x\", \"runs\": [1]}").valueType.has_value());
+        CHECK_FALSE(readResults("missing_results.json").valueType.has_value());
+    }
+
+    SUBCASE("Noise is the same, a clear slowdown past the threshold a regression") {
+        std::vector<double> baseline = {100, 103, 98, 101, 99, 102, 100};
+        Change same = relativeChange(baseline, {101, 99, 100, 102, 98, 103, 100});
+        CHECK(same.low <= 0);
+        CHECK(same.high >= 0);
+        CHECK(verdict(same, 0.05) == Verdict::Same);
+
+        std::vector<double> slower;
+        for (double run : baseline) {
+            slower.push_back(run * 1.2);
+        }
+        Change change = relativeChange(baseline, slower);
+        CHECK(change.estimate == doctest::Approx(0.2));
+        CHECK(change.low > 0);
+        CHECK(change.low <= change.estimate);
+        CHECK(change.estimate <= change.high);
+        CHECK(verdict(change, 0.05) == Verdict::Regression);
+        CHECK(verdict(change, 0.5) == Verdict::Slower);
+        CHECK(verdict(relativeChange(slower, baseline), 0.05) == Verdict::Faster);
+    }
+}
+
+TEST_CASE("Test synthetic corpus") {
+    CorpusOptions options;
+    options.bytes = 200000;
+    options.vocabulary = 3000;
+    options.apostrophes = 0.05;
+    options.hyphens = 0.05;
+    options.chapterWords = 10000;
+    auto vocabulary = makeVocabulary(options);
+    auto book = [&](const CorpusOptions& o) {
+        std::string text;
+        CorpusStats stats = generateBook(o, vocabulary)([&text](const std::string& block) { text += block; });
+        CHECK(stats.bytes == text.size());
+        return text;
+    };
+
+    SUBCASE("Vocabulary words are distinct, shortest first and survive filterText") {
+        CHECK(vocabulary.size() == 3000);
+        CHECK(std::set<std::string>(vocabulary.begin(), vocabulary.end()).size() == 3000);
+        CHECK(std::is_sorted(vocabulary.begin(), vocabulary.end(),
+                             [](const auto& a, const auto& b) { return a.size() < b.size(); }));
+        size_t decorated = 0;
+        for (const auto& word : vocabulary) {
+            CHECK(filterText(word).valueType.value() == word);
+            decorated += word.find_first_of("'-") != std::string::npos;
+        }
+        CHECK(decorated > 100);
+    }
+
+    SUBCASE("A seed always gives the same book") {
+        std::string text = book(options);
+        CHECK(text == book(options));
+        CorpusOptions other = options;
+        other.seed = 2;
+        CHECK(text != book(other));
+        CHECK(text.size() >= options.bytes);
+        CHECK(text.size() < options.bytes + 1000);
+    }
+
+    SUBCASE("The book is trimmed like War and Peace") {
+        std::string text = book(options);
+        auto trimmed = trimText("CHAPTER 1")("*** END OF THE PROJECT GUTENBERG EBOOK, WAR AND PEACE ***")(text);
+        REQUIRE(trimmed.valueType.has_value());
+        CHECK(trimmed.valueType.value().find("***") == std::string::npos);
+        CHECK(text.find("*** START OF") < text.find("CHAPTER 1"));
+
+        std::set<std::string> words;
+        for (const auto& word : insertIntoVector(filterText(trimmed.valueType.value()).valueType.value())) {
+            words.insert(word);
+        }
+        std::set<std::string> known = {"CHAPTER"};
+        for (const auto& word : vocabulary) {
+            known.insert(str_toupper(word));
+        }
+        CHECK(std::includes(known.begin(), known.end(), words.begin(), words.end()));
+        CHECK(words.size() > 1000);
+    }
+
+    SUBCASE("Letters are drawn in proportion to their frequencies") {
+        std::mt19937_64 engine(7);
+        std::vector<size_t> counts(26);
+        for (int i = 0; i < LETTER_TOTAL * 200; ++i) {
+            ++counts[randomLetter(engine) - 'a'];
+        }
+        for (int i = 0; i < 26; ++i) {
+            CHECK(counts[i] == doctest::Approx(200.0 * LETTER_FREQUENCIES[i]).epsilon(0.3));
+        }
+    }
+
+    SUBCASE("Alias sampler draws ranks in proportion to 1 / rank") {
+        AliasZipfSampler sampler(1000);
+        std::mt19937_64 engine(7);
+        std::vector<size_t> counts(1000);
+        for (int i = 0; i < 100000; ++i) {
+            ++counts[sampler(engine)];
+        }
+        CHECK(counts[1] > counts[9]);
+        CHECK(counts[0] == doctest::Approx(2.0 * counts[1]).epsilon(0.1));
+        CHECK(counts[0] == doctest::Approx(10.0 * counts[9]).epsilon(0.2));
+    }
+
+    SUBCASE("Sizes with suffixes") {
+        CHECK(parseSize("512").valueType.value() == 512);
+        CHECK(parseSize("3M").valueType.value() == 3 << 20);
+        CHECK(parseSize("10G").valueType.value() == uint64_t{10} << 30);
+        CHECK(parseSize("2k").valueType.value() == 2048);
+        CHECK_FALSE(parseSize("3MB").valueType.has_value());
+        CHECK_FALSE(parseSize("lots").valueType.has_value());
+    }
+}
@@ -39,7 +39,7 @@ Color rootColor(const RBTree<T>& locRoot) {
 }
 
 template<typename T>
-inline T root(const RBTree<T>& locRoot) {
+inline const T& root(const RBTree<T>& locRoot) {
     return locRoot->_val;
 }
 
@@ -120,7 +120,7 @@ std::function<RBTree<T>(const T&)> ins(const RBTree<T>& locRoot) {
         if (isEmpty(locRoot))
             return std::make_shared<const Node<T>>(R, RBTree<T>(), x, RBTree<T>());
         
-        T y = root(locRoot);
+        const T& y = root(locRoot);
         Color c = rootColor(locRoot);
 
         if (x < y)
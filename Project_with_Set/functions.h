@@ -47,8 +47,8 @@ auto isAlpha = [](const auto& character) {
 auto filterText = [](const auto& text) -> Maybe<std::string> {
     using namespace std::ranges;
 
-    auto transformed = views::iota(0, (int)text.size())
-        | views::transform([&](int index) {
+    auto transformed = views::iota(size_t{0}, text.size())
+        | views::transform([&](size_t index) {
             char c = text[index];
             if (isAlpha(c)) {
                 return c;
@@ -65,7 +65,10 @@ auto filterText = [](const auto& text) -> Maybe<std::string> {
         });
      
         
-    return {std::string(transformed.begin(), transformed.end())};
+    std::string result;
+    result.reserve(text.size());
+    copy(transformed, std::back_inserter(result));
+    return {result};
 };
 
 auto treeToVector = [](const auto& tree){
@@ -87,6 +90,31 @@ auto outPut = [](const std::stringstream& result) {
     };
 };
 
+auto outputSize = [](const auto& tree) {
+    size_t size = 0;
+    forEach(tree, [&size](const auto& word) {
+        size += word.size() + 1;
+    });
+    return size;
+};
+
+auto writeTree = [](const auto& tree) {
+    return [&tree](const char* filePath) {
+        std::string buffer;
+        buffer.reserve(outputSize(tree));
+        forEach(tree, [&buffer](const auto& word) {
+            buffer.append(word);
+            buffer.push_back('\n');
+        });
+
+        std::ofstream file(filePath, std::ios::binary);
+        if(!file){
+            std::cerr << "\nCould not open file\n";
+        }
+        file.write(buffer.data(), buffer.size());
+    };
+};
+
 auto readFileIntoString = [](const auto& filename) -> Maybe<std::string> {
     std::ifstream file(filename, std::ios::binary | std::ios::ate);
     if (!file) {
@@ -150,6 +150,38 @@ DOCTEST_TEST_CASE("Test outPut with empty stringstream") {
     std::remove(filePath);
 }
 
+TEST_CASE("Test outputSize function") {
+    SUBCASE("Counts one newline per word") {
+        std::vector<std::string> words = {"b", "apple", "cc"};
+        RBTree<std::string> tree = inserted(RBTree<std::string>())(words.begin(), words.end());
+        CHECK(outputSize(tree) == 11);
+    }
+
+    SUBCASE("Empty tree") {
+        RBTree<std::string> emptyTree;
+        CHECK(outputSize(emptyTree) == 0);
+    }
+}
+
+TEST_CASE("Test writeTree function") {
+    std::vector<std::string> words = {"banana", "apple", "orange"};
+    RBTree<std::string> tree = inserted(RBTree<std::string>())(words.begin(), words.end());
+
+    const char* streamPath = "stream_test_output.txt";
+    const char* treePath = "tree_test_output.txt";
+    outPut(insertIntoStream(treeToVector(tree)))(streamPath);
+    writeTree(tree)(treePath);
+
+    auto expected = readFileIntoString(streamPath);
+    auto written = readFileIntoString(treePath);
+
+    REQUIRE(written.valueType.has_value());
+    CHECK(written.valueType.value() == "apple\nbanana\norange\n");
+    CHECK(written.valueType.value() == expected.valueType.value());
+    std::remove(streamPath);
+    std::remove(treePath);
+}
+
 TEST_CASE("Test readFileIntoString function") {
     
     SUBCASE("Non-existent file") {
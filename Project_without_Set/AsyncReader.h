@@ -0,0 +1,415 @@
+#pragma once
+
+#include "functions.h"
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define HAVE_IO_URING 1
+#endif
+
+enum class ReaderKind { Sync, Pread, Uring };
+
+struct FileContents {
+    size_t index;
+    std::string text;
+};
+
+// Hands finished files from the reader to the tokenizer workers. push blocks
+// while capacity files are waiting, which bounds how much text is in memory.
+struct FileQueue {
+    size_t capacity;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<FileContents> files;
+    bool closed = false;
+
+    explicit FileQueue(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {}
+
+    void push(FileContents file) {
+        std::unique_lock lock(mutex);
+        changed.wait(lock, [this] { return files.size() < capacity; });
+        files.push_back(std::move(file));
+        changed.notify_all();
+    }
+
+    std::optional<FileContents> pop() {
+        std::unique_lock lock(mutex);
+        changed.wait(lock, [this] { return !files.empty() || closed; });
+        if (files.empty()) {
+            return std::nullopt;
+        }
+        FileContents file = std::move(files.front());
+        files.pop_front();
+        changed.notify_all();
+        return file;
+    }
+
+    void close() {
+        std::lock_guard lock(mutex);
+        closed = true;
+        changed.notify_all();
+    }
+};
+
+// threads readers, each taking the next unread path
+template<class Read>
+void readWithThreads(const std::vector<std::string>& paths, unsigned threads, FileQueue& queue, Read read) {
+    std::atomic<size_t> next = 0;
+    std::vector<std::future<void>> readers;
+    for (unsigned t = 0; t < std::max(1u, threads); ++t) {
+        readers.push_back(std::async(std::launch::async, [&]() {
+            for (size_t i = next++; i < paths.size(); i = next++) {
+                queue.push({i, read(paths[i])});
+            }
+        }));
+    }
+    for (auto& r : readers) {
+        r.get();
+    }
+}
+
+auto readFileSync = [](const std::string& path) {
+    return readFileIntoString(path).valueType.value_or("");
+};
+
+auto readFilePread = [](const std::string& path) {
+    std::string text;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return text;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0) {
+        text.resize(info.st_size);
+        size_t done = 0;
+        while (done < text.size()) {
+            ssize_t n = pread(fd, text.data() + done, text.size() - done, done);
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        text.resize(done);
+    }
+    close(fd);
+    return text;
+};
+
+#ifdef HAVE_IO_URING
+
+// Minimal io_uring wrapper on the raw syscalls, so no liburing is needed
+struct Uring {
+    int fd = -1;
+    unsigned entries = 0;
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+    unsigned pending = 0;   // queued, not yet submitted
+    unsigned inKernel = 0;  // submitted, not yet reaped
+
+    explicit Uring(unsigned depth) {
+        io_uring_params params{};
+        fd = syscall(__NR_io_uring_setup, depth, &params);
+        if (fd < 0) {
+            return;
+        }
+        entries = params.sq_entries;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cqRing = single ? sqRing
+            : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+            release();
+            return;
+        }
+
+        auto sq = static_cast<char*>(sqRing);
+        auto cq = static_cast<char*>(cqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    ~Uring() {
+        release();
+    }
+
+    void release() {
+        if (sqes != MAP_FAILED) munmap(sqes, entries * sizeof(io_uring_sqe));
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (fd >= 0) close(fd);
+        sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        sqRing = cqRing = MAP_FAILED;
+        fd = -1;
+    }
+
+    bool ok() const {
+        return fd >= 0;
+    }
+
+    bool registerBuffers(std::vector<iovec>& buffers) {
+        return syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()) == 0;
+    }
+
+    // Queues one read; submitAndWait hands everything queued to the kernel
+    void queueRead(int file, char* buffer, unsigned length, off_t offset, int bufferIndex, uint64_t tag) {
+        unsigned tail = *sqTail;
+        unsigned slot = tail & *sqMask;
+        io_uring_sqe& sqe = sqes[slot];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = bufferIndex >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READV;
+        sqe.fd = file;
+        sqe.off = offset;
+        sqe.user_data = tag;
+        if (bufferIndex >= 0) {
+            sqe.addr = reinterpret_cast<uint64_t>(buffer);
+            sqe.len = length;
+            sqe.buf_index = bufferIndex;
+        } else {
+            // READV needs an iovec that lives until completion; the caller's buffer slot holds one
+            sqe.addr = reinterpret_cast<uint64_t>(buffer);
+            sqe.len = 1;
+        }
+        sqArray[slot] = slot;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++pending;
+    }
+
+    // A signal or a full completion queue only interrupts the call, so it is made again
+    bool submitAndWait() {
+        while (true) {
+            int submitted = syscall(__NR_io_uring_enter, fd, pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (submitted >= 0) {
+                pending -= submitted;
+                inKernel += submitted;
+                return true;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                return false;
+            }
+        }
+    }
+
+    // Calls f(tag, result) for every finished read
+    template<class F>
+    void reap(F f) {
+        unsigned head = *cqHead;
+        while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe& cqe = cqes[head & *cqMask];
+            f(cqe.user_data, cqe.res);
+            ++head;
+            --inKernel;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    // Waits for every submitted read, discarding the results. Until then the
+    // kernel may still write into their buffers and read from their files.
+    void drain() {
+        reap([](uint64_t, int) {});
+        while (inKernel > 0) {
+            if (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+                && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                sched_yield();
+            }
+            reap([](uint64_t, int) {});
+        }
+    }
+};
+
+// Keeps up to inFlight files open, each with one outstanding read into its own
+// registered buffer. Returns the indices of the paths it could not read: all of
+// them if io_uring is unavailable, the rest if the ring fails along the way.
+inline std::vector<size_t> readWithUring(const std::vector<std::string>& paths, unsigned inFlight, FileQueue& queue) {
+    constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    std::vector<size_t> unread;
+    inFlight = std::max(1u, inFlight);
+    Uring ring(inFlight);
+    if (!ring.ok()) {
+        for (size_t i = 0; i < paths.size(); ++i) {
+            unread.push_back(i);
+        }
+        return unread;
+    }
+    inFlight = std::min(inFlight, ring.entries);
+
+    struct Slot {
+        std::vector<char> buffer;
+        iovec vector;
+        int fd = -1;
+        size_t index = 0;
+        size_t size = 0;
+        std::string text;
+    };
+    std::vector<Slot> slots(inFlight);
+    std::vector<iovec> buffers;
+    for (auto& slot : slots) {
+        slot.buffer.resize(BUFFER_SIZE);
+        slot.vector = {slot.buffer.data(), BUFFER_SIZE};
+        buffers.push_back(slot.vector);
+    }
+    bool fixed = ring.registerBuffers(buffers);
+
+    auto readNext = [&](unsigned s) {
+        Slot& slot = slots[s];
+        size_t offset = slot.text.size();
+        unsigned length = std::min(BUFFER_SIZE, slot.size - offset);
+        slot.vector.iov_len = length;
+        char* target = fixed ? slot.buffer.data() : reinterpret_cast<char*>(&slot.vector);
+        ring.queueRead(slot.fd, target, length, offset, fixed ? static_cast<int>(s) : -1, s);
+    };
+
+    size_t nextPath = 0;
+    size_t active = 0;
+    // Opens the next readable file in slot s; false when no paths are left
+    auto startFile = [&](unsigned s) {
+        Slot& slot = slots[s];
+        while (nextPath < paths.size()) {
+            slot.index = nextPath++;
+            slot.text.clear();
+            slot.fd = open(paths[slot.index].c_str(), O_RDONLY);
+            struct stat info;
+            if (slot.fd < 0 || fstat(slot.fd, &info) != 0 || info.st_size == 0) {
+                if (slot.fd >= 0) close(slot.fd);
+                slot.fd = -1;
+                queue.push({slot.index, ""});
+                continue;
+            }
+            slot.size = info.st_size;
+            slot.text.reserve(slot.size);
+            readNext(s);
+            ++active;
+            return true;
+        }
+        return false;
+    };
+
+    for (unsigned s = 0; s < inFlight; ++s) {
+        startFile(s);
+    }
+
+    while (active > 0) {
+        if (!ring.submitAndWait()) {
+            // The files being read are left to the caller once no read into their buffers is outstanding
+            ring.drain();
+            for (auto& slot : slots) {
+                if (slot.fd >= 0) {
+                    close(slot.fd);
+                    slot.fd = -1;
+                    unread.push_back(slot.index);
+                }
+            }
+            for (; nextPath < paths.size(); ++nextPath) {
+                unread.push_back(nextPath);
+            }
+            return unread;
+        }
+        ring.reap([&](uint64_t tag, int result) {
+            Slot& slot = slots[tag];
+            if (result == -EINTR || result == -EAGAIN) {
+                readNext(tag);
+                return;
+            }
+            if (result > 0) {
+                slot.text.append(slot.buffer.data(), result);
+            }
+            if (result > 0 && slot.text.size() < slot.size) {
+                readNext(tag);
+                return;
+            }
+            // A failed read or a file that got shorter is read again as it is now
+            if (slot.text.size() < slot.size) {
+                slot.text = readFilePread(paths[slot.index]);
+            }
+            close(slot.fd);
+            slot.fd = -1;
+            queue.push({slot.index, std::move(slot.text)});
+            --active;
+            startFile(tag);
+        });
+    }
+    return unread;
+}
+
+#else
+
+inline std::vector<size_t> readWithUring(const std::vector<std::string>& paths, unsigned, FileQueue&) {
+    std::vector<size_t> unread;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        unread.push_back(i);
+    }
+    return unread;
+}
+
+#endif
+
+// Reads every path into the queue and closes it; io_uring falls back to pread threads.
+// Returns the reader that actually ran, Pread when io_uring was unavailable or failed partway.
+auto readFiles = [](ReaderKind kind, unsigned inFlight) {
+    return [kind, inFlight](const std::vector<std::string>& paths, FileQueue& queue) {
+        if (kind == ReaderKind::Uring) {
+            auto unread = readWithUring(paths, inFlight, queue);
+            if (unread.empty()) {
+                queue.close();
+                return ReaderKind::Uring;
+            }
+            if (unread.size() < paths.size()) {
+                for (size_t i : unread) {
+                    queue.push({i, readFilePread(paths[i])});
+                }
+                queue.close();
+                return ReaderKind::Pread;
+            }
+        }
+        if (kind == ReaderKind::Sync)
+            readWithThreads(paths, inFlight, queue, readFileSync);
+        else
+            readWithThreads(paths, inFlight, queue, readFilePread);
+        queue.close();
+        return kind == ReaderKind::Sync ? ReaderKind::Sync : ReaderKind::Pread;
+    };
+};
+
+auto parseReaderKind = [](const std::string& name) {
+    if (name == "uring") return ReaderKind::Uring;
+    if (name == "pread") return ReaderKind::Pread;
+    return ReaderKind::Sync;
+};
@@ -0,0 +1,292 @@
+#pragma once
+
+#include "functions.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * Minimal acyclic automaton (.dawg) of a sorted vocabulary
+ *
+ *   header   AutomatonHeader
+ *   targets  uint32_t per arc: target state | LAST_ARC | FINAL_ARC
+ *   labels   one byte per arc
+ *
+ * A state is the index of its first arc; its arcs are stored next to each
+ * other in label order and the last one carries LAST_ARC. FINAL_ARC marks that
+ * a word ends after following the arc, so states that only differ in being
+ * final still share their arcs. States without arcs are NO_STATE.
+ *
+ * Built with the incremental algorithm for sorted input (Daciuk et al.):
+ * once a word is passed, the states below its common prefix with the next
+ * word can no longer change and are merged with an equivalent registered one.
+ * A state is only written after every state it leads to, so every target is
+ * lower than the arc pointing to it; opening a file checks that, along with
+ * the root and the LAST_ARC ending every state, so no lookup or walk can
+ * leave the mapping or go around in a cycle.
+ **/
+
+constexpr char AUTOMATON_MAGIC[4] = {'D', 'A', 'W', '1'};
+constexpr uint32_t LAST_ARC = 1u << 31;
+constexpr uint32_t FINAL_ARC = 1u << 30;
+constexpr uint32_t NO_STATE = FINAL_ARC - 1;
+
+struct AutomatonHeader {
+    char magic[4];
+    uint32_t root;
+    uint64_t wordCount;
+    uint64_t arcCount;
+};
+
+struct AutomatonBuilder {
+    struct PendingArc {
+        char label;
+        uint32_t target;
+        bool final;
+    };
+    struct PendingState {
+        bool final = false;
+        std::vector<PendingArc> arcs;
+    };
+
+    uint64_t wordCount = 0;
+    bool sorted = true;
+    std::string previous;
+    std::vector<PendingState> path = std::vector<PendingState>(1);
+    std::vector<uint32_t> targets;
+    std::string labels;
+    std::unordered_map<std::string, uint32_t> registry;
+
+    uint32_t freeze(const PendingState& state) {
+        if (state.arcs.empty()) {
+            return NO_STATE;
+        }
+
+        std::string key;
+        key.reserve(state.arcs.size() * 5);
+        for (const auto& arc : state.arcs) {
+            uint32_t target = arc.target | (arc.final ? FINAL_ARC : 0);
+            key.push_back(arc.label);
+            key.append(reinterpret_cast<const char*>(&target), sizeof(target));
+        }
+
+        auto [it, added] = registry.try_emplace(std::move(key), static_cast<uint32_t>(targets.size()));
+        if (added) {
+            for (size_t i = 0; i < state.arcs.size(); ++i) {
+                const auto& arc = state.arcs[i];
+                targets.push_back(arc.target
+                    | (arc.final ? FINAL_ARC : 0)
+                    | (i + 1 == state.arcs.size() ? LAST_ARC : 0));
+                labels.push_back(arc.label);
+            }
+        }
+        return it->second;
+    }
+
+    // Freezes the pending states deeper than depth and hangs them off their parents
+    void freezeDownTo(size_t depth) {
+        while (path.size() > depth + 1) {
+            PendingState state = std::move(path.back());
+            path.pop_back();
+            path.back().arcs.push_back({previous[path.size() - 1], freeze(state), state.final});
+        }
+    }
+
+    void add(std::string_view word) {
+        if ((wordCount > 0 && !(previous < word)) || word.empty()) {
+            sorted = false;
+            return;
+        }
+
+        size_t shared = 0;
+        size_t limit = std::min(previous.size(), word.size());
+        while (shared < limit && previous[shared] == word[shared]) {
+            ++shared;
+        }
+
+        freezeDownTo(shared);
+        path.resize(word.size() + 1);
+        path.back().final = true;
+
+        previous.assign(word);
+        ++wordCount;
+    }
+
+    Maybe<std::string> finish() {
+        if (!sorted || targets.size() + path.size() >= NO_STATE) {
+            return {std::nullopt};
+        }
+
+        freezeDownTo(0);
+        AutomatonHeader header{};
+        std::copy(std::begin(AUTOMATON_MAGIC), std::end(AUTOMATON_MAGIC), header.magic);
+        header.root = freeze(path.front());
+        header.wordCount = wordCount;
+        header.arcCount = targets.size();
+
+        std::string file;
+        file.reserve(sizeof(header) + targets.size() * sizeof(uint32_t) + labels.size());
+        file.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.append(reinterpret_cast<const char*>(targets.data()), targets.size() * sizeof(uint32_t));
+        file.append(labels);
+        return {file};
+    }
+};
+
+// A mapped .dawg file; all pointers point into the mapping
+struct Automaton {
+    Mapping file;
+    const AutomatonHeader* header;
+    const uint32_t* targets;
+    const char* labels;
+};
+
+auto encodeAutomaton = [](const auto& tree) -> Maybe<std::string> {
+    AutomatonBuilder builder;
+    forEach(tree, [&builder](const auto& word) {
+        builder.add(word);
+    });
+    return builder.finish();
+};
+
+auto writeAutomaton = [](const auto& tree) {
+    return [&tree](const char* filePath) {
+        auto encoded = encodeAutomaton(tree);
+        return encoded.valueType.has_value() && writeBuffer(encoded.valueType.value())(filePath);
+    };
+};
+
+// A state starts at arc 0 or right after a LAST_ARC
+inline bool stateStart(const uint32_t* targets, uint32_t state) {
+    return state == 0 || (targets[state - 1] & LAST_ARC);
+}
+
+// Targets point to the start of an earlier state, the root to any state, and
+// the last arc ends a state
+inline bool validArcs(const uint32_t* targets, uint64_t arcCount, uint32_t root) {
+    uint64_t state = 0;
+    for (uint64_t arc = 0; arc < arcCount; ++arc) {
+        uint32_t target = targets[arc] & NO_STATE;
+        if (target != NO_STATE && (target >= state || !stateStart(targets, target))) {
+            return false;
+        }
+        if (targets[arc] & LAST_ARC) {
+            state = arc + 1;
+        }
+    }
+    return state == arcCount && (root == NO_STATE || (root < arcCount && stateStart(targets, root)));
+}
+
+auto openAutomaton = [](const std::string& filePath) -> Maybe<Automaton> {
+    Mapping file = mapFile(filePath);
+    if (!file || file->size < sizeof(AutomatonHeader)) {
+        return {std::nullopt};
+    }
+
+    auto header = reinterpret_cast<const AutomatonHeader*>(file->data);
+    size_t rest = file->size - sizeof(AutomatonHeader);
+    if (!std::equal(std::begin(AUTOMATON_MAGIC), std::end(AUTOMATON_MAGIC), header->magic)
+        || header->arcCount > rest / (sizeof(uint32_t) + 1)
+        || header->arcCount * (sizeof(uint32_t) + 1) != rest) {
+        return {std::nullopt};
+    }
+
+    auto targets = reinterpret_cast<const uint32_t*>(file->data + sizeof(AutomatonHeader));
+    if (!validArcs(targets, header->arcCount, header->root)) {
+        return {std::nullopt};
+    }
+    auto labels = file->data + sizeof(AutomatonHeader) + header->arcCount * sizeof(uint32_t);
+    return {Automaton{file, header, targets, labels}};
+};
+
+// Index of the arc leaving state with label c, or NO_STATE
+inline uint32_t findArc(const Automaton& automaton, uint32_t state, char c) {
+    if (state == NO_STATE) {
+        return NO_STATE;
+    }
+    for (uint32_t arc = state; ; ++arc) {
+        if (automaton.labels[arc] == c) {
+            return arc;
+        }
+        if (automaton.targets[arc] & LAST_ARC) {
+            return NO_STATE;
+        }
+    }
+}
+
+inline uint32_t arcTarget(const Automaton& automaton, uint32_t arc) {
+    return automaton.targets[arc] & NO_STATE;
+}
+
+auto acceptsWord = [](const Automaton& automaton) {
+    return [&automaton](std::string_view word) {
+        uint32_t state = automaton.header->root;
+        bool final = false;
+        for (char c : word) {
+            uint32_t arc = findArc(automaton, state, c);
+            if (arc == NO_STATE) {
+                return false;
+            }
+            final = automaton.targets[arc] & FINAL_ARC;
+            state = arcTarget(automaton, arc);
+        }
+        return final;
+    };
+};
+
+template<class F>
+void forEachFrom(const Automaton& automaton, uint32_t state, std::string& word, F& f) {
+    if (state == NO_STATE) {
+        return;
+    }
+    for (uint32_t arc = state; ; ++arc) {
+        word.push_back(automaton.labels[arc]);
+        if (automaton.targets[arc] & FINAL_ARC) {
+            f(std::string_view(word));
+        }
+        forEachFrom(automaton, arcTarget(automaton, arc), word, f);
+        word.pop_back();
+        if (automaton.targets[arc] & LAST_ARC) {
+            return;
+        }
+    }
+}
+
+// Calls f in sorted order with every word that starts with prefix
+template<class F>
+void forEachWithPrefix(const Automaton& automaton, std::string_view prefix, F f) {
+    uint32_t state = automaton.header->root;
+    bool final = false;
+    for (char c : prefix) {
+        uint32_t arc = findArc(automaton, state, c);
+        if (arc == NO_STATE) {
+            return;
+        }
+        final = automaton.targets[arc] & FINAL_ARC;
+        state = arcTarget(automaton, arc);
+    }
+
+    std::string word(prefix);
+    if (final) {
+        f(std::string_view(word));
+    }
+    forEachFrom(automaton, state, word, f);
+}
+
+// output.txt -> .dawg
+auto buildAutomaton = [](const std::string& textPath) {
+    return [textPath](const char* automatonPath) {
+        Mapping text = mapFile(textPath);
+        if (!text) {
+            return false;
+        }
+
+        AutomatonBuilder builder;
+        forEachLine(text, [&builder](std::string_view word) {
+            builder.add(word);
+        });
+        auto encoded = builder.finish();
+        return encoded.valueType.has_value() && writeBuffer(encoded.valueType.value())(automatonPath);
+    };
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "functions.h"
+#include "Corpus.h"
+#include "Vocabulary.h"
+#include <array>
+#include <filesystem>
+
+/**
+ * Content-defined chunk cache
+ *
+ * The text is cut into chunks where a rolling (gear) hash of the last 64
+ * bytes hits a pattern, so a boundary depends only on the bytes around it: an
+ * edit changes the chunk it falls into, and the boundaries after it come back
+ * where they were. Cuts are moved forward to just after whitespace, so every
+ * chunk tokenizes exactly as it does inside the whole text.
+ *
+ * The words of every chunk are kept as a front-coded vocabulary named after a
+ * 64-bit hash of the chunk's content. The book's vocabulary is the union of
+ * its chunk trees; only chunks missing from the cache are tokenized. Entries
+ * are never evicted.
+ **/
+
+constexpr size_t CHUNK_MIN_SIZE = 2 << 10;
+constexpr size_t CHUNK_MAX_SIZE = 64 << 10;
+constexpr int CHUNK_AVERAGE_BITS = 13;  // a boundary after 8 KiB past the minimum on average
+// Changes whenever tokenizing changes, so older cache entries are not used
+constexpr uint64_t CHUNK_CACHE_VERSION = 1;
+
+// Random value per byte for the gear hash, from splitmix64
+constexpr std::array<uint64_t, 256> GEAR = [] {
+    std::array<uint64_t, 256> table{};
+    uint64_t state = 0x6a09e667f3bcc908;
+    for (auto& entry : table) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        entry = z ^ (z >> 31);
+    }
+    return table;
+}();
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+// End offsets of the chunks of text
+auto chunkBoundaries = [](std::string_view text) {
+    std::vector<size_t> ends;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t limit = std::min(text.size(), start + CHUNK_MAX_SIZE);
+        size_t end = limit;
+        uint64_t hash = 0;
+        for (size_t i = std::min(limit, start + CHUNK_MIN_SIZE); i < limit; ++i) {
+            hash = (hash << 1) + GEAR[static_cast<unsigned char>(text[i])];
+            if ((hash >> (64 - CHUNK_AVERAGE_BITS)) == 0) {
+                end = i;
+                break;
+            }
+        }
+
+        // Only cut right after whitespace; without any in reach a long word is split
+        if (end < text.size()) {
+            size_t space = end;
+            while (space < limit && !isSpace(text[space])) {
+                ++space;
+            }
+            if (space == limit) {
+                space = end;
+                while (space > start && !isSpace(text[space - 1])) {
+                    --space;
+                }
+                end = space > start ? space : limit;
+            } else {
+                end = space + 1;
+            }
+        }
+        ends.push_back(end);
+        start = end;
+    }
+    return ends;
+};
+
+// FNV-1a over the chunk, seeded with the cache version
+inline uint64_t chunkHash(std::string_view chunk) {
+    uint64_t hash = 0xcbf29ce484222325 ^ CHUNK_CACHE_VERSION;
+    for (char c : chunk) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+    }
+    return hash;
+}
+
+struct ChunkStats {
+    size_t chunks = 0;
+    size_t hits = 0;
+    size_t bytes = 0;
+    size_t tokenizedBytes = 0;
+};
+
+struct CachedBook {
+    RBTree<std::string> vocabulary;
+    ChunkStats stats;
+};
+
+auto chunkCachePath = [](const std::string& cacheDirectory, uint64_t hash) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.fcv", static_cast<unsigned long long>(hash));
+    return cacheDirectory + "/" + name;
+};
+
+// The chunk's words from the cache, or nothing if it has no usable entry
+auto loadChunk = [](const std::string& cachePath) -> Maybe<RBTree<std::string>> {
+    auto vocabulary = openVocabulary(cachePath);
+    if (!vocabulary.valueType.has_value()) {
+        return {std::nullopt};
+    }
+    std::vector<std::string> words;
+    words.reserve(wordCount(vocabulary.valueType.value()));
+    forEachWord(vocabulary.valueType.value(), [&words](std::string_view word) {
+        words.emplace_back(word);
+    });
+    return {fromSorted(words)};
+};
+
+auto cachedVocabulary = [](const std::string& cacheDirectory) {
+    return [cacheDirectory](std::string_view text) {
+        std::error_code error;
+        std::filesystem::create_directories(cacheDirectory, error);
+
+        CachedBook book;
+        size_t start = 0;
+        for (size_t end : chunkBoundaries(text)) {
+            std::string_view chunk = text.substr(start, end - start);
+            std::string cachePath = chunkCachePath(cacheDirectory, chunkHash(chunk));
+            start = end;
+
+            auto cached = loadChunk(cachePath);
+            RBTree<std::string> tree;
+            if (cached.valueType.has_value()) {
+                tree = cached.valueType.value();
+                ++book.stats.hits;
+            } else {
+                tree = textVocabulary(std::string(chunk));
+                auto encoded = encodeVocabulary(tree);
+                if (encoded.valueType.has_value()) {
+                    replaceFile(encoded.valueType.value())(cachePath);
+                }
+                book.stats.tokenizedBytes += chunk.size();
+            }
+            book.vocabulary = unite(book.vocabulary)(tree);
+            ++book.stats.chunks;
+            book.stats.bytes += chunk.size();
+        }
+        return book;
+    };
+};
+
+auto printChunkReport = [](const ChunkStats& stats) {
+    double hitRate = stats.chunks ? 100.0 * stats.hits / stats.chunks : 0;
+    std::cout << "Chunk cache: " << stats.hits << " of " << stats.chunks << " chunks cached (" << hitRate << "% hit rate), "
+              << stats.tokenizedBytes << " of " << stats.bytes << " bytes tokenized" << std::endl;
+};
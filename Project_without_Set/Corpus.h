@@ -0,0 +1,230 @@
+#pragma once
+
+#include "functions.h"
+#include "AsyncReader.h"
+#include <atomic>
+#include <filesystem>
+#include <map>
+
+// Spellings of the start and end lines used by Project Gutenberg over the years
+const std::vector<std::string> GUTENBERG_START_MARKERS = {
+    "*** START OF", "***START OF", "*END*THE SMALL PRINT"
+};
+const std::vector<std::string> GUTENBERG_END_MARKERS = {
+    "*** END OF", "***END OF", "End of the Project Gutenberg", "End of Project Gutenberg"
+};
+
+// Earliest position of any of the markers at or after from
+auto findFirst = [](const std::string& text, const std::vector<std::string>& markers, size_t from) {
+    size_t first = std::string::npos;
+    for (const auto& marker : markers) {
+        first = std::min(first, text.find(marker, from));
+    }
+    return first;
+};
+
+// Text between the Project Gutenberg start and end lines; the whole text if they are missing
+auto trimGutenberg = [](const std::string& text) -> Maybe<std::string> {
+    auto start_pos = findFirst(text, GUTENBERG_START_MARKERS, 0);
+    start_pos = start_pos == std::string::npos ? 0 : text.find('\n', start_pos);
+    start_pos = start_pos == std::string::npos ? text.size() : start_pos;
+
+    auto end_pos = findFirst(text, GUTENBERG_END_MARKERS, start_pos);
+    end_pos = end_pos == std::string::npos ? text.size() : end_pos;
+
+    return {text.substr(start_pos, end_pos - start_pos)};
+};
+
+auto listBooks = [](const std::string& directory) {
+    std::vector<std::string> books;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".txt") {
+            books.emplace_back(entry.path().string());
+        }
+    }
+    std::sort(books.begin(), books.end());
+    return books;
+};
+
+// A directory is searched for .txt books, any other file is read as a list of paths
+auto corpusFiles = [](const std::string& source) {
+    if (std::filesystem::is_directory(source)) {
+        return listBooks(source);
+    }
+
+    std::vector<std::string> books;
+    std::ifstream list(source);
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty()) {
+            books.emplace_back(line);
+        }
+    }
+    return books;
+};
+
+auto textVocabulary = [](const std::string& text) {
+    using namespace std::ranges;
+
+    auto words = insertIntoVector(filterText(text).valueType.value());
+    auto filteredWords = words | views::filter(filterInvalid);
+    return inserted(RBTree<std::string>())(filteredWords.begin(), filteredWords.end());
+};
+
+auto bookTextVocabulary = [](const std::string& text) {
+    return textVocabulary(trimGutenberg(text).valueType.value());
+};
+
+auto bookVocabulary = [](const std::string& filePath) {
+    return bookTextVocabulary(readFileIntoString(filePath).valueType.value_or(""));
+};
+
+struct Corpus {
+    std::vector<std::string> paths;
+    RBTree<std::string> vocabulary;
+    std::vector<RBTree<std::string>> books;  // only filled when asked for
+    size_t bytes = 0;
+    double seconds = 0;
+};
+
+// The reader fills a queue of finished files and one tokenizer worker per
+// core takes books from it; the queue holds at most two books per worker, so
+// memory stays bounded. Each worker unites its books into its own tree; the
+// worker trees are united at the end.
+auto loadCorpus = [](const std::vector<std::string>& paths) {
+    return [&paths](bool keepBooks, ReaderKind reader = ReaderKind::Sync, unsigned inFlight = 8) {
+        auto start = std::chrono::high_resolution_clock::now();
+        Corpus corpus;
+        corpus.paths = paths;
+        corpus.books.resize(keepBooks ? paths.size() : 0);
+
+        unsigned threads = std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(), paths.size()));
+        FileQueue queue(2 * threads);
+        auto reading = std::async(std::launch::async, [&]() {
+            readFiles(reader, inFlight)(paths, queue);
+        });
+
+        std::atomic<size_t> bytes = 0;
+        auto worker = [&]() {
+            RBTree<std::string> vocabulary;
+            while (auto file = queue.pop()) {
+                bytes += file->text.size();
+                RBTree<std::string> book = bookTextVocabulary(file->text);
+                vocabulary = unite(vocabulary)(book);
+                if (keepBooks) {
+                    corpus.books[file->index] = book;
+                }
+            }
+            return vocabulary;
+        };
+
+        std::vector<std::future<RBTree<std::string>>> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.push_back(std::async(std::launch::async, worker));
+        }
+        for (auto& w : workers) {
+            corpus.vocabulary = unite(corpus.vocabulary)(w.get());
+        }
+        reading.get();
+
+        corpus.bytes = bytes;
+        corpus.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        return corpus;
+    };
+};
+
+auto printCorpusReport = [](const Corpus& corpus) {
+    double megabytes = corpus.bytes / (1024.0 * 1024.0);
+    std::cout << "Books: " << corpus.paths.size()
+              << ", " << megabytes << " MB"
+              << ", " << treeSize(corpus.vocabulary) << " distinct words" << std::endl;
+    std::cout << "Throughput: " << megabytes / corpus.seconds << " MB/s, "
+              << corpus.paths.size() / corpus.seconds << " books/s" << std::endl;
+};
+
+// <book><suffix> per book; books of a list can share a name across directories,
+// so those get their position in the list as well: <book>.<i><suffix>
+auto bookOutputPaths = [](const std::vector<std::string>& paths, const std::string& suffix) {
+    std::map<std::string, size_t> stems;
+    for (const auto& path : paths) {
+        ++stems[std::filesystem::path(path).stem().string()];
+    }
+    std::vector<std::string> outPaths;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        std::string stem = std::filesystem::path(paths[i]).stem().string();
+        outPaths.push_back(stems[stem] > 1 ? stem + "." + std::to_string(i + 1) + suffix : stem + suffix);
+    }
+    return outPaths;
+};
+
+// Writes output.txt for the whole corpus, and <book>.vocab.txt per book if asked
+auto corpusMode = [](const std::string& source) {
+    return [source](bool perBook, ReaderKind reader, unsigned inFlight) {
+        Corpus corpus = loadCorpus(corpusFiles(source))(perBook, reader, inFlight);
+        parallelWriteTree(corpus.vocabulary)("output.txt");
+        auto outPaths = bookOutputPaths(corpus.paths, ".vocab.txt");
+        for (size_t i = 0; i < corpus.books.size(); ++i) {
+            writeTree(corpus.books[i])(outPaths[i].c_str());
+        }
+        printCorpusReport(corpus);
+    };
+};
+
+// For every tree, the keys no other tree has. Unions of all trees before and
+// after each position are kept persistently, so this takes O(n) set operations.
+auto uniqueWords = [](const std::vector<RBTree<std::string>>& trees) {
+    size_t n = trees.size();
+    std::vector<RBTree<std::string>> before(n + 1);
+    std::vector<RBTree<std::string>> after(n + 1);
+    for (size_t i = 0; i < n; ++i) {
+        before[i + 1] = unite(before[i])(trees[i]);
+        after[n - i - 1] = unite(after[n - i])(trees[n - i - 1]);
+    }
+
+    std::vector<RBTree<std::string>> unique;
+    for (size_t i = 0; i < n; ++i) {
+        RBTree<std::string> others = unite(before[i])(after[i + 1]);
+        unique.push_back(difference(trees[i])(others));
+    }
+    return unique;
+};
+
+// Writes <book>.unique.txt for every book in the directory
+auto uniqueWordsMode = [](const std::string& directory) {
+    Corpus corpus = loadCorpus(listBooks(directory))(true);
+    const auto& books = corpus.paths;
+    const auto& trees = corpus.books;
+
+    auto unique = uniqueWords(trees);
+    for (size_t i = 0; i < books.size(); ++i) {
+        std::string outPath = std::filesystem::path(books[i]).stem().string() + ".unique.txt";
+        writeTree(unique[i])(outPath.c_str());
+        std::cout << books[i] << ": " << treeSize(unique[i]) << " of " << treeSize(trees[i]) << " words unique" << std::endl;
+    }
+};
+
+// Times every reader on the same files without tokenizing them
+auto readerBenchmark = [](const std::string& source) {
+    return [source](unsigned inFlight) {
+        auto paths = corpusFiles(source);
+        for (auto [name, kind] : {std::pair{"sync ", ReaderKind::Sync}, {"pread", ReaderKind::Pread}, {"uring", ReaderKind::Uring}}) {
+            auto start = std::chrono::high_resolution_clock::now();
+            FileQueue queue(2 * inFlight);
+            auto reading = std::async(std::launch::async, [&]() {
+                return readFiles(kind, inFlight)(paths, queue);
+            });
+            size_t bytes = 0;
+            while (auto file = queue.pop()) {
+                bytes += file->text.size();
+            }
+            // A uring row that fell back to pread says so instead of passing off pread's numbers
+            bool fellBack = reading.get() != kind;
+
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            std::cout << name << ": " << paths.size() << " files, " << bytes / (1024.0 * 1024.0) / seconds << " MB/s, "
+                      << paths.size() / seconds << " files/s" << (fellBack ? " (io_uring failed, read with pread)" : "")
+                      << std::endl;
+        }
+    };
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "functions.h"
+#include "Merge.h"
+#include "Vocabulary.h"
+
+/**
+ * External-memory vocabulary build
+ *
+ * The budget is checked after every word, and once the tree grows past it
+ * the tree is written out word by word through a TextSink as a sorted run
+ * (the same format as output.txt) and ingestion continues with an empty tree.
+ * At the end the runs are merged k-way (Merge.h), dropping duplicates,
+ * straight into the output file. Peak memory is the budget plus one word,
+ * one output buffer and the chunk of text being read (STREAM_CHUNK_SIZE in
+ * Stream.h). A front-coded output has its index before the data, so the
+ * two go to temporary files next to it while merging and are put together
+ * behind the header at the end.
+ **/
+
+// Rough heap footprint of a string tree: nodes with their control blocks plus the words
+inline size_t treeMemory(const RBTree<std::string>& t) {
+    return treeSize(t) * (sizeof(Node<std::string>) + 2 * sizeof(void*)) + treeBytes(t);
+}
+
+constexpr size_t FRONT_CODED_BUFFER = 1 << 20;
+
+// Appends the whole file at path to out
+inline bool appendFile(std::ofstream& out, const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    if (in.peek() != std::ifstream::traits_type::eof()) {
+        out << in.rdbuf();
+    }
+    return static_cast<bool>(out);
+}
+
+// Front-codes the merged runs into outPath with about bufferBytes of data in memory
+auto mergeRunsIntoFrontCoded = [](const std::vector<std::string>& runs) {
+    return [&runs](const std::string& outPath, size_t bufferBytes = FRONT_CODED_BUFFER) {
+        std::string dataPath = outPath + ".data";
+        std::string indexPath = outPath + ".index";
+        std::ofstream data(dataPath, std::ios::binary);
+        std::ofstream index(indexPath, std::ios::binary);
+        FrontCoder coder;
+        auto flush = [&]() {
+            data.write(coder.data.data(), coder.data.size());
+            index.write(reinterpret_cast<const char*>(coder.offsets.data()), coder.offsets.size() * sizeof(uint64_t));
+            coder.flushed += coder.data.size();
+            coder.data.clear();
+            coder.offsets.clear();
+        };
+        bool ok = mergeRuns(runs, [&](std::string_view word) {
+            coder.add(word);
+            if (coder.data.size() >= bufferBytes) {
+                flush();
+            }
+        });
+        flush();
+        data.close();
+        index.close();
+        ok = ok && coder.sorted && data && index;
+
+        if (ok) {
+            VocabularyHeader header = coder.header();
+            std::ofstream out(outPath, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            ok = appendFile(out, indexPath) && appendFile(out, dataPath);
+        }
+        std::remove(dataPath.c_str());
+        std::remove(indexPath.c_str());
+        return ok;
+    };
+};
+
+// Merges the runs into output.txt, or into a front-coded vocabulary if the path ends in .fcv
+auto mergeRunsInto = [](const std::vector<std::string>& runs) {
+    return [&runs](const std::string& outPath) {
+        if (outPath.ends_with(".fcv")) {
+            return mergeRunsIntoFrontCoded(runs)(outPath);
+        }
+        return mergeVocabularyFiles(runs)(outPath);
+    };
+};
+
+struct SpillingTree {
+    size_t memoryBudget = 0;  // 0 keeps everything in memory
+    std::string spillDirectory = ".";
+    RBTree<std::string> tree;
+    std::vector<std::string> runs;
+    bool spillFailed = false;  // a run could not be written, so finish fails
+
+    void spill() {
+        if (isEmpty(tree)) {
+            return;
+        }
+        std::string runPath = spillDirectory + "/run_" + std::to_string(getpid()) + "_" + std::to_string(runs.size()) + ".txt";
+        TextSink sink(runPath.c_str());
+        forEach(tree, [&sink](const std::string& word) { sink.add(word); });
+        if (!sink.finish()) {
+            spillFailed = true;
+        }
+        runs.push_back(runPath);
+        tree = RBTree<std::string>();
+    }
+
+    void spillIfNeeded() {
+        if (memoryBudget > 0 && treeMemory(tree) > memoryBudget) {
+            spill();
+        }
+    }
+
+    // treeMemory is O(1), so the budget can be checked after every word
+    void add(const std::string& word) {
+        tree = insert(tree)(word);
+        spillIfNeeded();
+    }
+
+    // Writes the final vocabulary and removes the runs
+    bool finish(const std::string& outPath) {
+        bool ok;
+        if (runs.empty() && outPath.ends_with(".fcv")) {
+            ok = writeVocabulary(tree)(outPath.c_str());
+        } else if (runs.empty()) {
+            ok = parallelWriteTree(tree)(outPath.c_str());
+        } else {
+            spill();
+            ok = !spillFailed && mergeRunsInto(runs)(outPath);
+            for (const auto& run : runs) {
+                std::remove(run.c_str());
+            }
+            runs.clear();
+        }
+        return ok;
+    }
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Latency histograms for single tree operations
+ *
+ * LatencyHistogram keeps log-linear buckets like HdrHistogram: values below
+ * 32 ns are exact, above that every power of two is split into 32 buckets,
+ * so any percentile is within about 3% for 15 KiB per histogram, whatever
+ * the range. Recording is an increment without locks: every thread records
+ * into its own histograms, which are merged when the report is printed.
+ * Nothing is recorded until recordLatencies(true); -DDISABLE_PROFILING
+ * removes the timers.
+ **/
+
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 5;
+    static constexpr uint64_t SUB_BUCKETS = uint64_t{1} << SUB_BITS;
+    static constexpr size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    void record(uint64_t value) {
+        ++_counts[bucket(value)];
+        ++_total;
+        _max = std::max(_max, value);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            _counts[i] += other._counts[i];
+        }
+        _total += other._total;
+        _max = std::max(_max, other._max);
+    }
+
+    uint64_t count() const {
+        return _total;
+    }
+
+    uint64_t max() const {
+        return _max;
+    }
+
+    // Highest value in the bucket holding the p-th fraction of all values
+    uint64_t percentile(double p) const {
+        if (_total == 0) {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p * _total + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += _counts[i];
+            if (seen >= rank) {
+                return std::min(highestInBucket(i), _max);
+            }
+        }
+        return _max;
+    }
+
+    static size_t bucket(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return value;
+        }
+        int shift = std::bit_width(value) - 1 - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    static uint64_t highestInBucket(size_t index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        int shift = index / SUB_BUCKETS - 1;
+        uint64_t low = (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+        return low + (uint64_t{1} << shift) - 1;
+    }
+
+private:
+    std::array<uint64_t, BUCKETS> _counts{};
+    uint64_t _total = 0;
+    uint64_t _max = 0;
+};
+
+enum class Operation { Insert, Merge, Lookup };
+constexpr const char* OPERATION_NAMES[] = {"insert", "merge", "lookup"};
+constexpr size_t OPERATION_COUNT = 3;
+
+using OperationHistograms = std::array<LatencyHistogram, OPERATION_COUNT>;
+
+// Owns every thread's histograms, so they outlive the threads
+struct LatencyRecorder {
+    std::atomic<bool> enabled{false};
+    std::mutex lock;
+    std::vector<std::unique_ptr<OperationHistograms>> threads;
+};
+
+inline LatencyRecorder LATENCIES;
+
+inline void recordLatencies(bool enabled) {
+    LATENCIES.enabled = enabled;
+}
+
+inline OperationHistograms& threadHistograms() {
+    thread_local OperationHistograms* mine = [] {
+        std::lock_guard<std::mutex> guard(LATENCIES.lock);
+        LATENCIES.threads.push_back(std::make_unique<OperationHistograms>());
+        return LATENCIES.threads.back().get();
+    }();
+    return *mine;
+}
+
+// All threads' histograms of one operation together; threads must be done recording
+inline LatencyHistogram mergedLatencies(Operation operation) {
+    std::lock_guard<std::mutex> guard(LATENCIES.lock);
+    LatencyHistogram merged;
+    for (const auto& histograms : LATENCIES.threads) {
+        merged.merge((*histograms)[static_cast<size_t>(operation)]);
+    }
+    return merged;
+}
+
+inline void resetLatencies() {
+    std::lock_guard<std::mutex> guard(LATENCIES.lock);
+    for (auto& histograms : LATENCIES.threads) {
+        *histograms = OperationHistograms();
+    }
+}
+
+#ifndef DISABLE_PROFILING
+
+class LatencyTimer {
+public:
+    explicit LatencyTimer(Operation operation)
+        : _operation(operation), _recording(LATENCIES.enabled.load(std::memory_order_relaxed)) {
+        if (_recording) {
+            _start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~LatencyTimer() {
+        if (_recording) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start);
+            threadHistograms()[static_cast<size_t>(_operation)].record(elapsed.count());
+        }
+    }
+
+    LatencyTimer(const LatencyTimer&) = delete;
+    LatencyTimer& operator=(const LatencyTimer&) = delete;
+
+private:
+    Operation _operation;
+    bool _recording;
+    std::chrono::steady_clock::time_point _start;
+};
+
+#else
+
+class LatencyTimer {
+public:
+    explicit LatencyTimer(Operation) {}
+};
+
+#endif
+
+auto printLatencies = []() {
+    std::printf("\n%-8s %12s %10s %10s %10s %10s\n", "latency", "count", "p50 ns", "p99 ns", "p999 ns", "max ns");
+    for (size_t i = 0; i < OPERATION_COUNT; ++i) {
+        LatencyHistogram histogram = mergedLatencies(static_cast<Operation>(i));
+        if (histogram.count() == 0) {
+            continue;
+        }
+        std::printf("%-8s %12llu %10llu %10llu %10llu %10llu\n", OPERATION_NAMES[i],
+                    static_cast<unsigned long long>(histogram.count()),
+                    static_cast<unsigned long long>(histogram.percentile(0.5)),
+                    static_cast<unsigned long long>(histogram.percentile(0.99)),
+                    static_cast<unsigned long long>(histogram.percentile(0.999)),
+                    static_cast<unsigned long long>(histogram.max()));
+    }
+    std::fflush(stdout);
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Snapshot.h"
+#include "Stream.h"
+#include <filesystem>
+
+/**
+ * Incremental ingestion of a file that only grows
+ *
+ * Between runs two files are kept next to each other:
+ *
+ *   <state>.rbm    the latest vocabulary versions (Snapshot.h); the last
+ *                  root is the vocabulary up to the recorded offset
+ *   <state>.state  IncrementalHeader, then the text read but not yet
+ *                  tokenized (a word or marker that may still continue)
+ *
+ * A run reads the file from the recorded offset only, feeds the tail through
+ * the streaming state machine and inserts it into the last version. Versions
+ * share everything path copying left untouched, so the new words are a diff
+ * of two roots and each version adds only its new words to the .rbm file.
+ * Only the last `history` versions are kept, so the file and the time to
+ * thaw and rewrite it stay bounded by the vocabulary and a few diffs, however
+ * many runs there were.
+ *
+ * The .rbm file is replaced before the .state file. A crash in between leaves
+ * a version that already holds the tail; reading the tail again inserts the
+ * same words, so the vocabulary stays right.
+ **/
+
+constexpr char INCREMENTAL_MAGIC[4] = {'I', 'N', 'C', '1'};
+constexpr size_t INCREMENTAL_HISTORY = 16;
+
+struct IncrementalHeader {
+    char magic[4];
+    uint32_t phase;
+    uint64_t offset;
+    uint64_t pendingBytes;
+};
+
+struct IncrementalResult {
+    std::vector<RBTree<std::string>> versions;
+    std::vector<std::string> added;
+    uint64_t offset = 0;
+    uint64_t bytes = 0;  // read in this run
+};
+
+auto encodeIncrementalState = [](const StreamState& state, uint64_t offset) {
+    IncrementalHeader header{};
+    std::copy(std::begin(INCREMENTAL_MAGIC), std::end(INCREMENTAL_MAGIC), header.magic);
+    header.phase = state.phase;
+    header.offset = offset;
+    header.pendingBytes = state.pending.size();
+
+    std::string file;
+    file.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.append(state.pending);
+    return file;
+};
+
+// Restores phase and pending text into state; the offset they belong to, or nothing without a valid state
+auto loadIncrementalState = [](const std::string& filePath, StreamState& state) -> Maybe<uint64_t> {
+    Mapping file = mapFile(filePath);
+    if (!file || file->size < sizeof(IncrementalHeader)) {
+        return {std::nullopt};
+    }
+    auto header = reinterpret_cast<const IncrementalHeader*>(file->data);
+    if (!std::equal(std::begin(INCREMENTAL_MAGIC), std::end(INCREMENTAL_MAGIC), header->magic)
+        || sizeof(IncrementalHeader) + header->pendingBytes != file->size || header->phase > StreamState::Body) {
+        return {std::nullopt};
+    }
+    state.phase = static_cast<StreamState::Phase>(header->phase);
+    state.pending.assign(file->data + sizeof(IncrementalHeader), header->pendingBytes);
+    return {header->offset};
+};
+
+auto ingestAppended = [](const std::string& startMarker) {
+    return [startMarker](const std::string& endMarker) {
+        return [startMarker, endMarker](const std::string& filePath, const std::string& statePath,
+                                        size_t history = INCREMENTAL_HISTORY) -> Maybe<IncrementalResult> {
+            std::ifstream file(filePath, std::ios::binary);
+            if (!file) {
+                return {std::nullopt};
+            }
+            uint64_t fileSize = std::filesystem::file_size(filePath);
+
+            IncrementalResult result;
+            StreamState state;
+            state.startMarker = startMarker;
+            state.endMarker = endMarker;
+            state.phase = startMarker.empty() ? StreamState::Body : StreamState::Searching;
+            auto offset = loadIncrementalState(statePath + ".state", state);
+            auto versions = openVersions(statePath + ".rbm");
+            // A file shorter than what was read before was rewritten, so it is read from the start;
+            // so is one whose saved versions are corrupt
+            bool resumable = offset.valueType.has_value() && versions.valueType.has_value() && offset.valueType.value() <= fileSize;
+            auto thawed = resumable ? thawVersions(versions.valueType.value()) : Maybe<std::vector<RBTree<std::string>>>{std::nullopt};
+            if (thawed.valueType.has_value()) {
+                result.versions = thawed.valueType.value();
+                result.offset = offset.valueType.value();
+            } else {
+                state.phase = startMarker.empty() ? StreamState::Body : StreamState::Searching;
+                state.pending.clear();
+            }
+
+            RBTree<std::string> previous = result.versions.empty() ? RBTree<std::string>() : result.versions.back();
+            state.vocabulary.tree = previous;
+
+            // The end of the file may be a word that is still being written, so it stays pending
+            file.seekg(result.offset);
+            std::string chunk(STREAM_CHUNK_SIZE, '\0');
+            while (file.read(chunk.data(), chunk.size()) || file.gcount() > 0) {
+                state.pending.append(chunk.data(), file.gcount());
+                result.bytes += file.gcount();
+                processPending(state, false);
+            }
+            result.offset += result.bytes;
+
+            result.added = diff(previous)(state.vocabulary.tree).added;
+            if (result.versions.empty() || !result.added.empty()) {
+                result.versions.push_back(state.vocabulary.tree);
+            }
+            if (result.versions.size() > std::max<size_t>(history, 1)) {
+                result.versions.erase(result.versions.begin(), result.versions.end() - std::max<size_t>(history, 1));
+            }
+
+            if (!replaceFile(encodeVersions(result.versions))(statePath + ".rbm")
+                || !replaceFile(encodeIncrementalState(state, result.offset))(statePath + ".state")) {
+                return {std::nullopt};
+            }
+            return {result};
+        };
+    };
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only view of a whole file, unmapped when the last copy goes away
+struct MappedFile {
+    const char* data;
+    size_t size;
+};
+
+using Mapping = std::shared_ptr<const MappedFile>;
+
+inline Mapping mapFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    size_t size = info.st_size;
+    void* data = nullptr;
+    if (size > 0) {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return nullptr;
+        }
+    }
+    close(fd);
+
+    return Mapping(new MappedFile{static_cast<const char*>(data), size}, [](const MappedFile* file) {
+        if (file->size > 0) {
+            munmap(const_cast<char*>(file->data), file->size);
+        }
+        delete file;
+    });
+}
+
+// Calls f with every line of a mapped text file, without the trailing newline
+template<class F>
+void forEachLine(const Mapping& file, F f) {
+    const char* it = file->data;
+    const char* end = file->data + file->size;
+    while (it < end) {
+        const char* newline = static_cast<const char*>(memchr(it, '\n', end - it));
+        const char* lineEnd = newline ? newline : end;
+        f(std::string_view(it, lineEnd - it));
+        it = lineEnd + 1;
+    }
+}
@@ -0,0 +1,84 @@
+#include "Memory.h"
+
+// The replaced global operators; see Memory.h. Without -DTRACK_ALLOCATIONS
+// this file is empty and the standard operators stay in place.
+
+#ifdef TRACK_ALLOCATIONS
+
+namespace {
+
+constexpr size_t ALLOCATION_HEADER = 16;
+
+void* trackedAllocate(size_t size) {
+    auto* block = static_cast<char*>(std::malloc(size + ALLOCATION_HEADER));
+    if (!block) {
+        return nullptr;
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+
+    ALLOCATIONS.allocations.fetch_add(1, std::memory_order_relaxed);
+    ALLOCATIONS.bytes.fetch_add(size, std::memory_order_relaxed);
+    size_t live = ALLOCATIONS.live.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = ALLOCATIONS.peak.load(std::memory_order_relaxed);
+    while (live > peak && !ALLOCATIONS.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    return block + ALLOCATION_HEADER;
+}
+
+void trackedFree(void* pointer) {
+    if (!pointer) {
+        return;
+    }
+    char* block = static_cast<char*>(pointer) - ALLOCATION_HEADER;
+    ALLOCATIONS.frees.fetch_add(1, std::memory_order_relaxed);
+    ALLOCATIONS.live.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+}
+
+void* operator new(size_t size) {
+    void* pointer = trackedAllocate(size);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return trackedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return trackedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    trackedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    trackedFree(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    trackedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    trackedFree(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    trackedFree(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    trackedFree(pointer);
+}
+
+#endif
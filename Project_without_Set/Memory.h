@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+
+/**
+ * Allocation tracking
+ *
+ * Memory.cpp replaces the global operator new and delete by versions that
+ * keep a 16-byte size header in front of every block and count allocations,
+ * bytes, live bytes and the peak of live bytes. Tree nodes, which share one
+ * allocation with their shared_ptr control block, are additionally counted
+ * by NodeAllocator (RBTree.h).
+ *
+ * Tracking costs every allocation a header and a few atomic updates, so it
+ * is opt-in: only a program built with -DTRACK_ALLOCATIONS and linked with
+ * Memory.cpp (microbench, the profile build) counts anything. Everywhere
+ * else the counters stay 0.
+ **/
+
+struct AllocationCounters {
+    std::atomic<size_t> allocations{0};
+    std::atomic<size_t> frees{0};
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> live{0};
+    std::atomic<size_t> peak{0};
+};
+
+inline AllocationCounters ALLOCATIONS;
+
+// Starts a new peak from what is live right now
+inline void resetPeakHeap() {
+    ALLOCATIONS.peak.store(ALLOCATIONS.live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+// A "Vm...:" line of /proc/self/status in kB, 0 where it does not exist
+inline size_t statusKilobytes(const std::string& field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, field.size(), field) == 0) {
+            return std::strtoull(line.c_str() + field.size(), nullptr, 10);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "MappedFile.h"
+#include <charconv>
+#include <fstream>
+#include <vector>
+
+/**
+ * K-way merge of sorted vocabulary files
+ *
+ * Every input is a sorted file in the format of output.txt, one word per
+ * line, optionally followed by a tab and a count. Inputs are memory-mapped
+ * and read front to back, so memory is one cursor per file plus the output
+ * buffer, however large the files are. A loser tree picks the smallest word
+ * with about log2(k) comparisons per word, against about 2 log2(k) for a
+ * binary heap, which matters once thousands of files are merged.
+ *
+ * Equal words are merged into one and their counts summed; a line without a
+ * count counts as 1, so merging plain vocabularies counts the files that
+ * contain each word.
+ **/
+
+constexpr size_t OUTPUT_BUFFER_SIZE = 1 << 20;
+
+// Reads the lines of a mapped vocabulary one at a time
+struct RunCursor {
+    Mapping file;
+    const char* it;
+    const char* end;
+    std::string_view word;
+    uint64_t key = 0;  // first eight bytes of word, big-endian, so they compare as one integer
+    uint64_t count = 0;
+    bool done = false;
+
+    explicit RunCursor(Mapping mapping)
+        : file(mapping), it(mapping ? mapping->data : nullptr), end(mapping ? mapping->data + mapping->size : nullptr) {}
+
+    bool next() {
+        if (it >= end) {
+            done = true;
+            key = UINT64_MAX;
+            return false;
+        }
+        const char* newline = static_cast<const char*>(memchr(it, '\n', end - it));
+        const char* lineEnd = newline ? newline : end;
+        std::string_view line(it, lineEnd - it);
+        it = lineEnd + 1;
+
+        auto tab = line.find('\t');
+        word = line.substr(0, tab);
+        key = 0;
+        for (size_t i = 0; i < sizeof(key); ++i) {
+            key = key << 8 | (i < word.size() ? static_cast<unsigned char>(word[i]) : 0);
+        }
+        count = 1;
+        if (tab != std::string_view::npos) {
+            std::from_chars(line.data() + tab + 1, line.data() + line.size(), count);
+        }
+        return true;
+    }
+};
+
+// losers[0] is the cursor with the smallest word, every inner node holds the
+// loser of the match played there; leaves are implicit at k + i
+struct LoserTree {
+    std::vector<RunCursor>& cursors;
+    std::vector<size_t> losers;
+
+    explicit LoserTree(std::vector<RunCursor>& runs) : cursors(runs), losers(std::max<size_t>(1, runs.size())) {
+        for (auto& cursor : cursors) {
+            cursor.next();
+        }
+        losers[0] = cursors.size() > 1 ? play(1) : 0;
+    }
+
+    // Exhausted cursors lose against everything; equal words go to the earlier file.
+    // Most matches are decided by the keys alone, without touching the words.
+    bool wins(size_t a, size_t b) const {
+        if (cursors[a].key != cursors[b].key) {
+            return cursors[a].key < cursors[b].key;
+        }
+        if (cursors[a].done || cursors[b].done) {
+            return !cursors[a].done && cursors[b].done;
+        }
+        int order = cursors[a].word.compare(cursors[b].word);
+        return order < 0 || (order == 0 && a < b);
+    }
+
+    size_t play(size_t node) {
+        size_t k = cursors.size();
+        if (node >= k) {
+            return node - k;
+        }
+        size_t a = play(2 * node);
+        size_t b = play(2 * node + 1);
+        bool aWins = wins(a, b);
+        losers[node] = aWins ? b : a;
+        return aWins ? a : b;
+    }
+
+    bool empty() const {
+        return cursors.empty() || cursors[losers[0]].done;
+    }
+
+    const RunCursor& top() const {
+        return cursors[losers[0]];
+    }
+
+    // Advances the winner and replays its path to the root
+    void pop() {
+        size_t winner = losers[0];
+        cursors[winner].next();
+        for (size_t node = (winner + cursors.size()) / 2; node > 0; node /= 2) {
+            if (wins(losers[node], winner)) {
+                std::swap(losers[node], winner);
+            }
+        }
+        losers[0] = winner;
+    }
+};
+
+// Calls f(word, count) once for every distinct word of the sorted files, in
+// order; false if a file cannot be opened. The words point into the mappings
+// and are only valid during the call.
+template<class F>
+bool mergeCounts(const std::vector<std::string>& paths, F f) {
+    std::vector<RunCursor> cursors;
+    cursors.reserve(paths.size());
+    for (const auto& path : paths) {
+        Mapping file = mapFile(path);
+        if (!file) {
+            return false;
+        }
+        if (file->size > 0) {
+            madvise(const_cast<char*>(file->data), file->size, MADV_SEQUENTIAL);
+        }
+        cursors.emplace_back(file);
+    }
+
+    LoserTree tree(cursors);
+    while (!tree.empty()) {
+        std::string_view word = tree.top().word;
+        uint64_t count = 0;
+        while (!tree.empty() && tree.top().word == word) {
+            count += tree.top().count;
+            tree.pop();
+        }
+        f(word, count);
+    }
+    return true;
+}
+
+// Calls f once with every distinct word of the sorted runs, in order
+template<class F>
+bool mergeRuns(const std::vector<std::string>& runs, F f) {
+    return mergeCounts(runs, [&f](std::string_view word, uint64_t) { f(word); });
+}
+
+// Writes a sorted word stream as output.txt through a fixed-size buffer
+struct TextSink {
+    std::ofstream file;
+    std::string buffer;
+
+    explicit TextSink(const char* filePath) : file(filePath, std::ios::binary) {
+        buffer.reserve(OUTPUT_BUFFER_SIZE);
+    }
+
+    void add(std::string_view word) {
+        if (buffer.size() + word.size() + 1 > OUTPUT_BUFFER_SIZE) {
+            flush();
+        }
+        buffer.append(word);
+        buffer.push_back('\n');
+    }
+
+    void add(std::string_view word, uint64_t count) {
+        char digits[24];
+        auto [digitsEnd, error] = std::to_chars(std::begin(digits), std::end(digits), count);
+        size_t length = digitsEnd - digits;
+        if (buffer.size() + word.size() + length + 2 > OUTPUT_BUFFER_SIZE) {
+            flush();
+        }
+        buffer.append(word);
+        buffer.push_back('\t');
+        buffer.append(digits, length);
+        buffer.push_back('\n');
+    }
+
+    void flush() {
+        file.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+    bool finish() {
+        flush();
+        file.close();
+        return !file.fail();
+    }
+};
+
+// Merges sorted vocabulary files into one, with a tab and the summed count after each word if asked
+auto mergeVocabularyFiles = [](const std::vector<std::string>& paths) {
+    return [&paths](const std::string& outPath, bool withCounts = false) {
+        TextSink sink(outPath.c_str());
+        if (!sink.file) {
+            return false;
+        }
+        bool merged = mergeCounts(paths, [&sink, withCounts](std::string_view word, uint64_t count) {
+            if (withCounts) {
+                sink.add(word, count);
+            } else {
+                sink.add(word);
+            }
+        });
+        return merged && sink.finish();
+    };
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Performance counters for profiled stages
+ *
+ * Hardware counters (cycles, instructions, cache and branch misses) are
+ * opened with perf_event_open for this process and the threads it starts
+ * later, user space only. Where the CPU or the container does not offer
+ * them, the kernel's software counters are used, and where perf_event_open
+ * is not allowed at all, getrusage. Counters that the kernel multiplexed are
+ * scaled up to the whole time they were enabled.
+ **/
+
+struct PerfEvent {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+const std::vector<PerfEvent> HARDWARE_EVENTS = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+const std::vector<PerfEvent> SOFTWARE_EVENTS = {
+    {"task-clock-us", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {"ctx-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+};
+
+const std::vector<std::string> RUSAGE_NAMES = {"user-us", "system-us", "minor-faults", "major-faults", "ctx-switches"};
+
+enum class CounterSource { Hardware, Software, Rusage };
+
+inline int openPerfEvent(const PerfEvent& event) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+class PerfCounters {
+public:
+    CounterSource source = CounterSource::Rusage;
+    std::vector<std::string> names;
+
+    // All events of one kind or none, so the columns always mean the same thing
+    explicit PerfCounters(bool hardware = true) {
+        for (const auto* events : {&HARDWARE_EVENTS, &SOFTWARE_EVENTS}) {
+            if (events == &HARDWARE_EVENTS && !hardware) {
+                continue;
+            }
+            if (openAll(*events)) {
+                source = events == &HARDWARE_EVENTS ? CounterSource::Hardware : CounterSource::Software;
+                return;
+            }
+        }
+        names = RUSAGE_NAMES;
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+        closeAll();
+    }
+
+    std::vector<uint64_t> read() const {
+        std::vector<uint64_t> values;
+        if (source == CounterSource::Rusage) {
+            rusage usage{};
+            getrusage(RUSAGE_SELF, &usage);
+            auto micros = [](const timeval& t) { return static_cast<uint64_t>(t.tv_sec) * 1000000 + t.tv_usec; };
+            return {micros(usage.ru_utime), micros(usage.ru_stime), static_cast<uint64_t>(usage.ru_minflt),
+                    static_cast<uint64_t>(usage.ru_majflt), static_cast<uint64_t>(usage.ru_nvcsw + usage.ru_nivcsw)};
+        }
+
+        for (size_t i = 0; i < _fds.size(); ++i) {
+            uint64_t reading[3] = {0, 0, 0};  // value, time enabled, time running
+            if (::read(_fds[i], reading, sizeof(reading)) != sizeof(reading)) {
+                values.push_back(0);
+                continue;
+            }
+            uint64_t value = reading[2] > 0 && reading[2] < reading[1]
+                ? static_cast<uint64_t>(static_cast<double>(reading[0]) * reading[1] / reading[2])
+                : reading[0];
+            // task-clock counts nanoseconds
+            values.push_back(source == CounterSource::Software && i == 0 ? value / 1000 : value);
+        }
+        return values;
+    }
+
+    const char* sourceName() const {
+        return source == CounterSource::Hardware ? "hardware" : source == CounterSource::Software ? "software" : "getrusage";
+    }
+
+private:
+    std::vector<int> _fds;
+
+    bool openAll(const std::vector<PerfEvent>& events) {
+        for (const auto& event : events) {
+            int fd = openPerfEvent(event);
+            if (fd < 0) {
+                closeAll();
+                return false;
+            }
+            _fds.push_back(fd);
+            names.push_back(event.name);
+        }
+        return true;
+    }
+
+    void closeAll() {
+        for (int fd : _fds) {
+            close(fd);
+        }
+        _fds.clear();
+        names.clear();
+    }
+};
+
+// Set by enablePerfCounters; stages only read counters while it exists
+inline std::unique_ptr<PerfCounters> PERF_COUNTERS;
+
+inline const PerfCounters& enablePerfCounters(bool hardware = true) {
+    PERF_COUNTERS = std::make_unique<PerfCounters>(hardware);
+    return *PERF_COUNTERS;
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include "Memory.h"
+#include "PerfCounters.h"
+#include "RBTree.h"
+#include "Trace.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Per-stage timing and counters
+ *
+ * A StageTimer measures the scope it lives in and adds it to the stage of
+ * that name; items and bytes handled by the stage are added with count().
+ * Stages are listed in the order they first ran. Building with
+ * -DDISABLE_PROFILING turns everything here into empty inline functions.
+ *
+ * Every stage also gets the process's peak RSS so far and, in a build with
+ * -DTRACK_ALLOCATIONS (Memory.h), the allocations made while it ran on any
+ * thread, the tree nodes among them with their shared_ptr control blocks,
+ * and the peak of live heap bytes.
+ * Stages are expected to run one after the other, not nested. Once
+ * enablePerfCounters was called, the stage's performance counters
+ * (PerfCounters.h) are recorded as well.
+ **/
+
+struct StageRecord {
+    std::string name;
+    double milliseconds = 0;
+    size_t calls = 0;
+    size_t items = 0;
+    size_t bytes = 0;
+    size_t allocations = 0;
+    size_t allocatedBytes = 0;
+    size_t nodeBlocks = 0;
+    size_t nodeBlockBytes = 0;
+    size_t peakHeap = 0;
+    size_t peakRss = 0;
+    std::vector<uint64_t> counters;  // named by PERF_COUNTERS
+};
+
+struct Profile {
+    std::mutex lock;
+    std::vector<StageRecord> stages;
+
+    StageRecord& stage(const std::string& name) {
+        for (auto& record : stages) {
+            if (record.name == name) {
+                return record;
+            }
+        }
+        StageRecord record;
+        record.name = name;
+        stages.push_back(record);
+        return stages.back();
+    }
+};
+
+inline Profile& profile() {
+    static Profile instance;
+    return instance;
+}
+
+#ifndef DISABLE_PROFILING
+
+class StageTimer {
+public:
+    explicit StageTimer(const char* name) : _name(name), _span(name, "stage") {
+        {
+            std::lock_guard<std::mutex> guard(profile().lock);
+            profile().stage(_name);
+        }
+        resetPeakHeap();
+        _allocations = ALLOCATIONS.allocations.load(std::memory_order_relaxed);
+        _allocatedBytes = ALLOCATIONS.bytes.load(std::memory_order_relaxed);
+        _nodeBlocks = NODE_BLOCKS.load(std::memory_order_relaxed);
+        _nodeBlockBytes = NODE_BLOCK_BYTES.load(std::memory_order_relaxed);
+        if (PERF_COUNTERS) {
+            _counters = PERF_COUNTERS->read();
+        }
+        _start = std::chrono::steady_clock::now();
+    }
+
+    ~StageTimer() {
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+        std::vector<uint64_t> counters = PERF_COUNTERS ? PERF_COUNTERS->read() : std::vector<uint64_t>();
+        size_t allocations = ALLOCATIONS.allocations.load(std::memory_order_relaxed) - _allocations;
+        size_t allocatedBytes = ALLOCATIONS.bytes.load(std::memory_order_relaxed) - _allocatedBytes;
+        size_t nodeBlocks = NODE_BLOCKS.load(std::memory_order_relaxed) - _nodeBlocks;
+        size_t nodeBlockBytes = NODE_BLOCK_BYTES.load(std::memory_order_relaxed) - _nodeBlockBytes;
+        size_t peakHeap = ALLOCATIONS.peak.load(std::memory_order_relaxed);
+        size_t peakRss = statusKilobytes("VmHWM:") * 1024;
+
+        std::lock_guard<std::mutex> guard(profile().lock);
+        StageRecord& record = profile().stage(_name);
+        record.milliseconds += elapsed;
+        record.calls += 1;
+        record.items += _items;
+        record.bytes += _bytes;
+        record.allocations += allocations;
+        record.allocatedBytes += allocatedBytes;
+        record.nodeBlocks += nodeBlocks;
+        record.nodeBlockBytes += nodeBlockBytes;
+        record.peakHeap = std::max(record.peakHeap, peakHeap);
+        record.peakRss = std::max(record.peakRss, peakRss);
+        record.counters.resize(counters.size());
+        for (size_t i = 0; i < counters.size() && i < _counters.size(); ++i) {
+            record.counters[i] += counters[i] - _counters[i];
+        }
+    }
+
+    void count(size_t items, size_t bytes = 0) {
+        _items += items;
+        _bytes += bytes;
+    }
+
+private:
+    const char* _name;
+    TraceSpan _span;
+    std::chrono::steady_clock::time_point _start;
+    size_t _items = 0;
+    size_t _bytes = 0;
+    size_t _allocations;
+    size_t _allocatedBytes;
+    size_t _nodeBlocks;
+    size_t _nodeBlockBytes;
+    std::vector<uint64_t> _counters;
+};
+
+auto printProfile = []() {
+    std::lock_guard<std::mutex> guard(profile().lock);
+    double total = 0;
+    for (const auto& record : profile().stages) {
+        total += record.milliseconds;
+    }
+
+    std::printf("%-18s %10s %6s %6s %10s %10s %9s\n", "stage", "ms", "%", "calls", "items", "bytes", "MB/s");
+    for (const auto& record : profile().stages) {
+        double share = total > 0 ? 100.0 * record.milliseconds / total : 0;
+        double throughput = record.milliseconds > 0 ? record.bytes / 1048.576 / record.milliseconds : 0;
+        std::printf("%-18s %10.2f %6.1f %6zu %10zu %10zu %9.1f\n",
+                    record.name.c_str(), record.milliseconds, share, record.calls, record.items, record.bytes, throughput);
+    }
+
+    auto megabytes = [](size_t bytes) { return bytes / 1048576.0; };
+    std::printf("\n%-18s %10s %10s %10s %10s %10s %10s\n", "stage", "allocs", "alloc MB", "nodes", "node MB", "peak heap", "peak RSS");
+    for (const auto& record : profile().stages) {
+        std::printf("%-18s %10zu %10.1f %10zu %10.1f %10.1f %10.1f\n",
+                    record.name.c_str(), record.allocations, megabytes(record.allocatedBytes), record.nodeBlocks,
+                    megabytes(record.nodeBlockBytes), megabytes(record.peakHeap), megabytes(record.peakRss));
+    }
+
+    if (PERF_COUNTERS) {
+        bool hardware = PERF_COUNTERS->source == CounterSource::Hardware;
+        std::printf("\n%-18s", (std::string("stage (") + PERF_COUNTERS->sourceName() + ")").c_str());
+        for (const auto& name : PERF_COUNTERS->names) {
+            std::printf(" %14s", name.c_str());
+        }
+        if (hardware) {
+            std::printf(" %6s %12s", "IPC", "miss/kinstr");
+        }
+        std::printf("\n");
+        for (const auto& record : profile().stages) {
+            std::printf("%-18s", record.name.c_str());
+            for (size_t i = 0; i < PERF_COUNTERS->names.size(); ++i) {
+                std::printf(" %14llu", static_cast<unsigned long long>(i < record.counters.size() ? record.counters[i] : 0));
+            }
+            // cycles, instructions, cache-misses: few instructions per cycle with many misses means waiting on memory
+            if (hardware && record.counters.size() >= 3) {
+                double instructions = static_cast<double>(record.counters[1]);
+                std::printf(" %6.2f %12.2f", record.counters[0] ? instructions / record.counters[0] : 0.0,
+                            instructions > 0 ? 1000.0 * record.counters[2] / instructions : 0.0);
+            }
+            std::printf("\n");
+        }
+    }
+    std::fflush(stdout);
+};
+
+auto profileJson = []() {
+    std::lock_guard<std::mutex> guard(profile().lock);
+    std::string json = "{\"stages\": [";
+    for (size_t i = 0; i < profile().stages.size(); ++i) {
+        const auto& record = profile().stages[i];
+        json += i ? ",\n  " : "\n  ";
+        json += "{\"name\": \"" + record.name + "\", \"ms\": " + std::to_string(record.milliseconds)
+              + ", \"calls\": " + std::to_string(record.calls) + ", \"items\": " + std::to_string(record.items)
+              + ", \"bytes\": " + std::to_string(record.bytes)
+              + ", \"allocations\": " + std::to_string(record.allocations) + ", \"allocatedBytes\": " + std::to_string(record.allocatedBytes)
+              + ", \"nodeBlocks\": " + std::to_string(record.nodeBlocks) + ", \"nodeBlockBytes\": " + std::to_string(record.nodeBlockBytes)
+              + ", \"peakHeap\": " + std::to_string(record.peakHeap) + ", \"peakRss\": " + std::to_string(record.peakRss);
+        if (PERF_COUNTERS) {
+            json += std::string(", \"counterSource\": \"") + PERF_COUNTERS->sourceName() + "\", \"counters\": {";
+            for (size_t c = 0; c < PERF_COUNTERS->names.size() && c < record.counters.size(); ++c) {
+                json += (c ? ", \"" : "\"") + PERF_COUNTERS->names[c] + "\": " + std::to_string(record.counters[c]);
+            }
+            json += "}";
+        }
+        json += "}";
+    }
+    json += "\n]}\n";
+    return json;
+};
+
+#else
+
+class StageTimer {
+public:
+    explicit StageTimer(const char*) {}
+    void count(size_t, size_t = 0) {}
+};
+
+auto printProfile = []() {};
+
+auto profileJson = []() {
+    return std::string("{\"stages\": []}\n");
+};
+
+#endif
+
+// Runs work(timer) as the named stage and returns what it returns
+auto timedStage = [](const char* name) {
+    return [name](auto work) {
+        StageTimer timer(name);
+        return work(timer);
+    };
+};
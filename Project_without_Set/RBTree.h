@@ -1,15 +1,30 @@
+#pragma once
+
+#include <atomic>
 #include <cassert>
 #include <memory>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <algorithm>
 #include <future>
 #include <ranges>
 #include <vector>
+#include "Histogram.h"
+#include "Trace.h"
 
 enum Color { R, B };
 
 
+// Bytes a value takes up as one line of output.txt (word plus newline)
+template<typename T>
+inline size_t lineLength(const T& val) {
+    if constexpr (requires { val.size(); })
+        return val.size() + 1;
+    else
+        return 0;
+}
+
 template<typename T>
 struct Node {
     Node(Color c, 
@@ -17,16 +32,59 @@ struct Node {
         T val, 
         std::shared_ptr<const Node> const & rgt)
         : _c(c), _lft(lft), _val(val), _rgt(rgt)
-    {}
+    {
+        _size = 1 + (lft ? lft->_size : 0) + (rgt ? rgt->_size : 0);
+        _bytes = lineLength(_val) + (lft ? lft->_bytes : 0) + (rgt ? rgt->_bytes : 0);
+        _blackHeight = (lft ? lft->_blackHeight : 0) + (c == B ? 1 : 0);
+    }
     T _val;
     Color _c;
     std::shared_ptr<const Node> _lft;
     std::shared_ptr<const Node> _rgt;
+    size_t _size;   // elements in this subtree
+    size_t _bytes;  // output bytes of this subtree
+    int _blackHeight; // black nodes on a path down from here, this one included
 };
 
 template<typename T>
 using RBTree = std::shared_ptr<const Node<T>>;
 
+// Nodes are allocated together with their shared_ptr control block; with
+// -DTRACK_ALLOCATIONS these count those allocations apart from all others
+inline std::atomic<size_t> NODE_BLOCKS{0};
+inline std::atomic<size_t> NODE_BLOCK_BYTES{0};
+
+template<class U>
+struct NodeAllocator {
+    using value_type = U;
+
+    NodeAllocator() = default;
+    template<class V>
+    NodeAllocator(const NodeAllocator<V>&) {}
+
+    U* allocate(size_t n) {
+        NODE_BLOCKS.fetch_add(1, std::memory_order_relaxed);
+        NODE_BLOCK_BYTES.fetch_add(n * sizeof(U), std::memory_order_relaxed);
+        return std::allocator<U>().allocate(n);
+    }
+
+    void deallocate(U* p, size_t n) {
+        std::allocator<U>().deallocate(p, n);
+    }
+
+    template<class V>
+    bool operator==(const NodeAllocator<V>&) const { return true; }
+};
+
+template<class T, class... Args>
+RBTree<T> makeNode(Args&&... args) {
+#ifdef TRACK_ALLOCATIONS
+    return std::allocate_shared<const Node<T>>(NodeAllocator<Node<T>>(), std::forward<Args>(args)...);
+#else
+    return std::make_shared<const Node<T>>(std::forward<Args>(args)...);
+#endif
+}
+
 template<typename T>
 inline bool isEmpty(const RBTree<T>& locRoot) {
     return !locRoot;
@@ -38,7 +96,7 @@ Color rootColor(const RBTree<T>& locRoot) {
 }
 
 template<typename T>
-inline T root(const RBTree<T>& locRoot) {
+inline const T& root(const RBTree<T>& locRoot) {
     return locRoot->_val;
 }
 
@@ -52,10 +110,25 @@ inline RBTree<T> right(const RBTree<T>& locRoot) {
     return locRoot->_rgt;
 }
 
+template<typename T>
+inline size_t treeSize(const RBTree<T>& locRoot) {
+    return isEmpty(locRoot) ? 0 : locRoot->_size;
+}
+
+template<typename T>
+inline size_t treeBytes(const RBTree<T>& locRoot) {
+    return isEmpty(locRoot) ? 0 : locRoot->_bytes;
+}
+
+template<typename T>
+inline int blackHeight(const RBTree<T>& locRoot) {
+    return isEmpty(locRoot) ? 0 : locRoot->_blackHeight;
+}
+
 template<typename T>
 auto paint(Color c) {
     return [c](const RBTree<T>& locRoot) {
-        return std::make_shared<const Node<T>>(c, left(locRoot), root(locRoot), right(locRoot));
+        return makeNode<T>(c, left(locRoot), root(locRoot), right(locRoot));
     };
 }
 
@@ -87,27 +160,27 @@ auto balance(Color c) {
         return [c, &lft](const T& x) {
             return [c, &lft, x](const RBTree<T>& rgt) {
                 if (c == B && doubledLeft(lft))
-                    return std::make_shared<const Node<T>>(R, 
+                    return makeNode<T>(R, 
                         paintBlack<T>(left(lft)), 
                         root(lft), 
-                        std::make_shared<const Node<T>>(B, right(lft), x, rgt));
+                        makeNode<T>(B, right(lft), x, rgt));
                 else if (c == B && doubledRight(lft))
-                    return std::make_shared<const Node<T>>(R,
-                        std::make_shared<const Node<T>>(B, left(lft), root(lft), left(right(lft))),
+                    return makeNode<T>(R,
+                        makeNode<T>(B, left(lft), root(lft), left(right(lft))),
                         root(right(lft)), 
-                        std::make_shared<const Node<T>>(B, right(right(lft)), x, rgt));
+                        makeNode<T>(B, right(right(lft)), x, rgt));
                 else if (c == B && doubledLeft(rgt))
-                    return std::make_shared<const Node<T>>(R,
-                        std::make_shared<const Node<T>>(B, lft, x, left(left(rgt))), 
+                    return makeNode<T>(R,
+                        makeNode<T>(B, lft, x, left(left(rgt))), 
                         root(left(rgt)), 
-                        std::make_shared<const Node<T>>(B, right(left(rgt)), root(rgt), right(rgt)));
+                        makeNode<T>(B, right(left(rgt)), root(rgt), right(rgt)));
                 else if (c == B && doubledRight(rgt))
-                    return std::make_shared<const Node<T>>(R, 
-                        std::make_shared<const Node<T>>(B, lft, x, left(rgt)), 
+                    return makeNode<T>(R, 
+                        makeNode<T>(B, lft, x, left(rgt)), 
                         root(rgt), 
                         paintBlack<T>(right(rgt)));
                 else
-                    return std::make_shared<const Node<T>>(c, lft, x, rgt);
+                    return makeNode<T>(c, lft, x, rgt);
             };
         };
     };
@@ -117,9 +190,9 @@ template<typename T>
 std::function<RBTree<T>(const T&)> ins(const RBTree<T>& locRoot) {
     return [&locRoot](const T& x) -> RBTree<T> {
         if (isEmpty(locRoot))
-            return std::make_shared<const Node<T>>(R, RBTree<T>(), x, RBTree<T>());
+            return makeNode<T>(R, RBTree<T>(), x, RBTree<T>());
         
-        T y = root(locRoot);
+        const T& y = root(locRoot);
         Color c = rootColor(locRoot);
 
         if (x < y)
@@ -135,8 +208,27 @@ std::function<RBTree<T>(const T&)> ins(const RBTree<T>& locRoot) {
 template<typename T>
 auto insert(const RBTree<T>& locRoot) {
     return [&locRoot](const T& x) -> RBTree<T> {
+        LatencyTimer timer(Operation::Insert);
         RBTree<T> t = ins<T>(locRoot)(x);
-        return std::make_shared<const Node<T>>(B, left(t), root(t), right(t));
+        return makeNode<T>(B, left(t), root(t), right(t));
+    };
+}
+
+template<class T>
+auto contains(const RBTree<T>& t) {
+    return [&t](const T& x) {
+        LatencyTimer timer(Operation::Lookup);
+        const Node<T>* node = t.get();
+        while (node) {
+            if (x < node->_val) {
+                node = node->_lft.get();
+            } else if (node->_val < x) {
+                node = node->_rgt.get();
+            } else {
+                return true;
+            }
+        }
+        return false;
     };
 }
 
@@ -172,39 +264,351 @@ auto inserted(RBTree<T> t) {
     };
 }
 
+// Balanced tree from strictly increasing values in O(n): nodes on an
+// incomplete last level are red, all others black
+template<class T>
+RBTree<T> fromSorted(const T* values, size_t n, int depth, int redDepth) {
+    if (n == 0) {
+        return RBTree<T>();
+    }
+    size_t mid = n / 2;
+    return makeNode<T>(depth == redDepth ? R : B,
+        fromSorted(values, mid, depth + 1, redDepth),
+        values[mid],
+        fromSorted(values + mid + 1, n - mid - 1, depth + 1, redDepth));
+}
+
+template<class T>
+RBTree<T> fromSorted(const std::vector<T>& values) {
+    // Levels 0 .. full - 1 are complete
+    int full = 0;
+    while ((size_t{2} << full) - 1 <= values.size()) {
+        ++full;
+    }
+    return fromSorted(values.data(), values.size(), 0, full);
+}
+
 template<class T>
 auto merge(RBTree<T> left) {
     return [&left](const RBTree<T>& right) {
+        LatencyTimer timer(Operation::Merge);
         std::vector<T> elements;
         forEach(right, [&](const T& x) { elements.emplace_back(x); });
         return inserted(left)(elements.begin(), elements.end());
     };
 }
 
+// Ranges of up to threshold values are inserted by one task, and at most
+// threads tasks run at once (0: one thread per split). Only the scaling
+// benchmark changes them.
+struct ParallelSettings {
+    size_t threshold = 10000;
+    unsigned threads = 0;
+};
+
+inline ParallelSettings PARALLEL;
+
+// tasks is how many threads this range may still use, 0 for PARALLEL.threads
 template<class T>
-auto parallelInsert(RBTree<T> t) {
-    constexpr size_t PARALLEL_THRESHOLD = 10000;
+auto parallelInsert(RBTree<T> t, unsigned tasks = 0) {
+    if (tasks == 0) {
+        tasks = PARALLEL.threads ? PARALLEL.threads : std::numeric_limits<unsigned>::max();
+    }
 
-    return [t](auto begin, auto end) {
+    return [t, tasks](auto begin, auto end) {
         // Compute distance
         auto dist = std::ranges::distance(begin, end);
 
-        if (dist <= PARALLEL_THRESHOLD) {
+        if (static_cast<size_t>(dist) <= PARALLEL.threshold) {
             // Insert rest
+            TraceSpan leaf("inserted", "task", dist);
             return inserted(t)(begin, end);
         }
 
+        TraceSpan task("parallelInsert", "task", dist);
+
         // Split the range into two halves
         auto mid = begin;
         std::advance(mid, dist / 2);
 
-        // Process each half in parallel
-        auto leftFuture = std::async(std::launch::async, [&]() {
-            return parallelInsert(t)(begin, mid);
-        });
-        auto rightTree = parallelInsert(t)(mid, end);
+        // Process each half in parallel while threads are left, the same
+        // splits one after the other otherwise
+        unsigned leftTasks = tasks / 2;
+        RBTree<T> leftTree;
+        RBTree<T> rightTree;
+        if (leftTasks > 0) {
+            auto leftFuture = std::async(std::launch::async, [&]() {
+                return parallelInsert(t, leftTasks)(begin, mid);
+            });
+            rightTree = parallelInsert(t, tasks - leftTasks)(mid, end);
+            leftTree = leftFuture.get();
+        } else {
+            leftTree = parallelInsert(t, 1)(begin, mid);
+            rightTree = parallelInsert(t, 1)(mid, end);
+        }
 
         // Merge the results
-        return merge(leftFuture.get())(rightTree);
+        TraceSpan merging("merge", "merge", treeSize(rightTree));
+        return merge(leftTree)(rightTree);
+    };
+}
+
+template<class T>
+struct TreeDiff {
+    std::vector<T> added;
+    std::vector<T> removed;
+};
+
+// In-order cursor that can hand out whole subtrees before expanding them
+template<class T>
+struct DiffCursor {
+    // (node, true) stands for the node's value only, (node, false) for its whole subtree
+    std::vector<std::pair<RBTree<T>, bool>> stack;
+
+    explicit DiffCursor(const RBTree<T>& t) {
+        if (!isEmpty(t)) {
+            stack.emplace_back(t, false);
+        }
+    }
+
+    bool done() const { return stack.empty(); }
+    bool atValue() const { return stack.back().second; }
+    const RBTree<T>& top() const { return stack.back().first; }
+    size_t topSize() const { return atValue() ? 1 : treeSize(top()); }
+
+    void expand() {
+        RBTree<T> t = top();
+        stack.pop_back();
+        if (!isEmpty(right(t))) stack.emplace_back(right(t), false);
+        stack.emplace_back(t, true);
+        if (!isEmpty(left(t))) stack.emplace_back(left(t), false);
+    }
+
+    void skip() { stack.pop_back(); }
+};
+
+// Keys only in b are added, keys only in a are removed. Subtrees that both
+// versions share through path copying are skipped without being visited.
+template<class T>
+auto diff(const RBTree<T>& a) {
+    return [&a](const RBTree<T>& b) {
+        TreeDiff<T> result;
+        DiffCursor<T> from(a);
+        DiffCursor<T> to(b);
+
+        while (!from.done() && !to.done()) {
+            if (!from.atValue() && !to.atValue() && from.top() == to.top()) {
+                from.skip();
+                to.skip();
+            }
+            else if (!from.atValue() || !to.atValue()) {
+                // Open the bigger subtree first so shared ones line up on both stacks
+                if (!from.atValue() && (to.atValue() || from.topSize() >= to.topSize()))
+                    from.expand();
+                else
+                    to.expand();
+            }
+            else if (root(from.top()) < root(to.top())) {
+                result.removed.push_back(root(from.top()));
+                from.skip();
+            }
+            else if (root(to.top()) < root(from.top())) {
+                result.added.push_back(root(to.top()));
+                to.skip();
+            }
+            else {
+                from.skip();
+                to.skip();
+            }
+        }
+
+        auto drain = [](DiffCursor<T>& cursor, std::vector<T>& out) {
+            while (!cursor.done()) {
+                if (cursor.atValue()) {
+                    out.push_back(root(cursor.top()));
+                    cursor.skip();
+                } else {
+                    cursor.expand();
+                }
+            }
+        };
+        drain(from, result.removed);
+        drain(to, result.added);
+        return result;
+    };
+}
+
+/**
+ * Join-based set algebra (Blelloch, Ferizovic, Sun: "Just Join for Parallel
+ * Ordered Sets"). join(l, k, r) needs every key of l below k and every key of
+ * r above it; everything else is split and join.
+ **/
+
+template<class T>
+RBTree<T> blacken(const RBTree<T>& t) {
+    return isEmpty(t) || rootColor(t) == B ? t : paintBlack<T>(t);
+}
+
+// Hangs r into the right spine of the taller l; balance repairs red-red on the way up
+template<class T>
+RBTree<T> joinRight(const RBTree<T>& l, const T& k, const RBTree<T>& r) {
+    if ((isEmpty(l) || rootColor(l) == B) && blackHeight(l) == blackHeight(r))
+        return makeNode<T>(R, l, k, r);
+    return balance<T>(rootColor(l))(left(l))(root(l))(joinRight(right(l), k, r));
+}
+
+template<class T>
+RBTree<T> joinLeft(const RBTree<T>& l, const T& k, const RBTree<T>& r) {
+    if ((isEmpty(r) || rootColor(r) == B) && blackHeight(l) == blackHeight(r))
+        return makeNode<T>(R, l, k, r);
+    return balance<T>(rootColor(r))(joinLeft(l, k, left(r)))(root(r))(right(r));
+}
+
+template<class T>
+RBTree<T> join(const RBTree<T>& l, const T& k, const RBTree<T>& r) {
+    RBTree<T> bl = blacken(l);
+    RBTree<T> br = blacken(r);
+    if (blackHeight(bl) > blackHeight(br))
+        return joinRight(bl, k, br);
+    if (blackHeight(br) > blackHeight(bl))
+        return joinLeft(bl, k, br);
+    return makeNode<T>(R, bl, k, br);
+}
+
+template<class T>
+struct Split {
+    RBTree<T> less;
+    bool found;
+    RBTree<T> greater;
+};
+
+template<class T>
+Split<T> split(const RBTree<T>& t, const T& k) {
+    if (isEmpty(t))
+        return {RBTree<T>(), false, RBTree<T>()};
+    if (k < root(t)) {
+        Split<T> s = split(left(t), k);
+        return {s.less, s.found, join(s.greater, root(t), right(t))};
+    }
+    if (root(t) < k) {
+        Split<T> s = split(right(t), k);
+        return {join(left(t), root(t), s.less), s.found, s.greater};
+    }
+    return {left(t), true, right(t)};
+}
+
+// Removes the largest key of a non-empty tree and returns it as well
+template<class T>
+std::pair<RBTree<T>, T> splitLast(const RBTree<T>& t) {
+    if (isEmpty(right(t)))
+        return {left(t), root(t)};
+    auto [rest, last] = splitLast(right(t));
+    return {join(left(t), root(t), rest), last};
+}
+
+// join without a middle key
+template<class T>
+RBTree<T> join2(const RBTree<T>& l, const RBTree<T>& r) {
+    if (isEmpty(l))
+        return r;
+    auto [rest, last] = splitLast(l);
+    return join(rest, last, r);
+}
+
+// Runs both halves of a divide step, the left one on another thread when the input
+// is larger than PARALLEL.threshold
+template<class T, class F, class G>
+std::pair<RBTree<T>, RBTree<T>> bothSides(size_t work, F leftSide, G rightSide) {
+    if (work <= PARALLEL.threshold)
+        return {leftSide(), rightSide()};
+    auto leftFuture = std::async(std::launch::async, leftSide);
+    RBTree<T> rightTree = rightSide();
+    return {leftFuture.get(), rightTree};
+}
+
+template<class T>
+RBTree<T> unionTrees(const RBTree<T>& a, const RBTree<T>& b) {
+    if (isEmpty(a) || a == b)
+        return b;
+    if (isEmpty(b))
+        return a;
+    Split<T> s = split(a, root(b));
+    auto work = treeSize(a) + treeSize(b);
+    auto [l, r] = bothSides<T>(work,
+        [&] { return unionTrees(s.less, left(b)); },
+        [&] { return unionTrees(s.greater, right(b)); });
+    return join(l, root(b), r);
+}
+
+template<class T>
+RBTree<T> intersectTrees(const RBTree<T>& a, const RBTree<T>& b) {
+    if (a == b)
+        return a;
+    if (isEmpty(a) || isEmpty(b))
+        return RBTree<T>();
+    Split<T> s = split(a, root(b));
+    auto work = treeSize(a) + treeSize(b);
+    auto [l, r] = bothSides<T>(work,
+        [&] { return intersectTrees(s.less, left(b)); },
+        [&] { return intersectTrees(s.greater, right(b)); });
+    return s.found ? join(l, root(b), r) : join2(l, r);
+}
+
+template<class T>
+RBTree<T> differenceTrees(const RBTree<T>& a, const RBTree<T>& b) {
+    if (isEmpty(a) || a == b)
+        return RBTree<T>();
+    if (isEmpty(b))
+        return a;
+    Split<T> s = split(a, root(b));
+    auto work = treeSize(a) + treeSize(b);
+    auto [l, r] = bothSides<T>(work,
+        [&] { return differenceTrees(s.less, left(b)); },
+        [&] { return differenceTrees(s.greater, right(b)); });
+    return join2(l, r);
+}
+
+template<class T>
+RBTree<T> symmetricDifferenceTrees(const RBTree<T>& a, const RBTree<T>& b) {
+    if (a == b)
+        return RBTree<T>();
+    if (isEmpty(a))
+        return b;
+    if (isEmpty(b))
+        return a;
+    Split<T> s = split(a, root(b));
+    auto work = treeSize(a) + treeSize(b);
+    auto [l, r] = bothSides<T>(work,
+        [&] { return symmetricDifferenceTrees(s.less, left(b)); },
+        [&] { return symmetricDifferenceTrees(s.greater, right(b)); });
+    return s.found ? join2(l, r) : join(l, root(b), r);
+}
+
+template<class T>
+auto unite(const RBTree<T>& a) {
+    return [&a](const RBTree<T>& b) {
+        return blacken(unionTrees(a, b));
+    };
+}
+
+template<class T>
+auto intersect(const RBTree<T>& a) {
+    return [&a](const RBTree<T>& b) {
+        return blacken(intersectTrees(a, b));
+    };
+}
+
+// Keys of a that are not in b
+template<class T>
+auto difference(const RBTree<T>& a) {
+    return [&a](const RBTree<T>& b) {
+        return blacken(differenceTrees(a, b));
+    };
+}
+
+template<class T>
+auto symmetricDifference(const RBTree<T>& a) {
+    return [&a](const RBTree<T>& b) {
+        return blacken(symmetricDifferenceTrees(a, b));
     };
 }
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "functions.h"
+#include "Trace.h"
+#include "../Benchmark/Results.h"
+#include <cstring>
+
+/**
+ * Thread scaling of parallelInsert
+ *
+ * The words of a book are inserted over and over with PARALLEL set to every
+ * combination of thread count and threshold. Capping the threads does not
+ * change the splits, only how many run at once, so every row does the same
+ * inserts and merges and the speedup is the threads' alone. The time spent in
+ * "inserted" leaves and in merges is read back from the trace; the last merge
+ * combines the two halves of the whole input on one thread, and its share of
+ * the wall time is how much of the run no thread count can shorten. Spans
+ * measure wall time, so with more threads than cores they include waiting
+ * for a core. Under -DDISABLE_PROFILING there are no spans and those
+ * columns stay 0.
+ **/
+
+struct ScalingPoint {
+    unsigned threads = 1;
+    size_t threshold = 0;
+    std::vector<double> runs;  // wall-clock milliseconds
+    size_t leaves = 0;         // "inserted" tasks per run
+    double leafMs = 0;         // per run, summed over threads
+    double mergeMs = 0;
+    double finalMergeMs = 0;
+};
+
+// 1, 2, 4, ... and the number of cores itself
+inline std::vector<unsigned> threadCounts(unsigned cores) {
+    std::vector<unsigned> counts;
+    for (unsigned threads = 1; threads < cores; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(std::max(cores, 1u));
+    return counts;
+}
+
+// Words as the default pipeline inserts them
+auto bookWords = [](const std::string& text) {
+    std::string book = trimText("CHAPTER 1")("*** END OF THE PROJECT GUTENBERG EBOOK, WAR AND PEACE ***")(text)
+                           .valueType.value_or(text);
+    std::vector<std::string> words;
+    for (auto& word : insertIntoVector(filterText(book).valueType.value_or(""))) {
+        if (filterInvalid(word)) {
+            words.push_back(std::move(word));
+        }
+    }
+    return words;
+};
+
+auto measureScaling = [](const std::vector<std::string>& words) {
+    return [&words](unsigned threads, size_t threshold, int repetitions) {
+        ScalingPoint point;
+        point.threads = threads;
+        point.threshold = threshold;
+        ParallelSettings saved = PARALLEL;
+        PARALLEL = {threshold, threads};
+        for (int i = 0; i < repetitions; ++i) {
+            startTrace();
+            auto start = std::chrono::steady_clock::now();
+            RBTree<std::string> tree = parallelInsert(RBTree<std::string>())(words.begin(), words.end());
+            point.runs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            stopTrace();
+
+            std::lock_guard<std::mutex> guard(TRACE.lock);
+            double lastEnd = 0;
+            double lastMerge = 0;
+            point.leaves = 0;
+            for (const TraceEvent& event : TRACE.events) {
+                if (std::strcmp(event.name, "inserted") == 0) {
+                    ++point.leaves;
+                    point.leafMs += event.duration / 1000 / repetitions;
+                } else if (std::strcmp(event.name, "merge") == 0) {
+                    point.mergeMs += event.duration / 1000 / repetitions;
+                    if (event.start + event.duration > lastEnd) {
+                        lastEnd = event.start + event.duration;
+                        lastMerge = event.duration;
+                    }
+                }
+            }
+            point.finalMergeMs += lastMerge / 1000 / repetitions;
+        }
+        PARALLEL = saved;
+        return point;
+    };
+};
+
+// Speedup over one thread, estimated from the fewest threads measured with the same threshold
+auto printScaling = [](const std::vector<ScalingPoint>& points) {
+    std::printf("%8s %10s %8s %10s %8s %10s %10s %10s %12s %8s\n", "threads", "threshold", "leaves", "median ms",
+                "speedup", "efficiency", "leaves ms", "merges ms", "last merge", "of wall");
+    for (const auto& point : points) {
+        const ScalingPoint* baseline = &point;
+        for (const auto& other : points) {
+            if (other.threshold == point.threshold && other.threads < baseline->threads) {
+                baseline = &other;
+            }
+        }
+        double median = summarize(point.runs).median;
+        double speedup = baseline->threads * summarize(baseline->runs).median / median;
+        std::printf("%8u %10zu %8zu %10.1f %8.2f %9.0f%% %10.1f %10.1f %12.1f %7.0f%%\n", point.threads, point.threshold,
+                    point.leaves, median, speedup, 100 * speedup / point.threads, point.leafMs, point.mergeMs,
+                    point.finalMergeMs, 100 * point.finalMergeMs / median);
+    }
+    std::fflush(stdout);
+};
+
+// In the layout of Benchmark's results files, one thread count and threshold per measurement
+auto scalingJson = [](const std::string& input, const std::vector<ScalingPoint>& points) {
+    std::string json = "{\"machine\": {\"cores\": " + std::to_string(std::thread::hardware_concurrency())
+                     + "},\n \"measurements\": [";
+    for (size_t i = 0; i < points.size(); ++i) {
+        const ScalingPoint& point = points[i];
+        Summary summary = summarize(point.runs);
+        std::string runs;
+        for (size_t r = 0; r < point.runs.size(); ++r) {
+            runs += (r ? ", " : "") + std::to_string(point.runs[r]);
+        }
+        json += (i ? ",\n" : "\n") + std::string("{\"engine\": ")
+              + jsonString("parallelInsert threads=" + std::to_string(point.threads) + " threshold=" + std::to_string(point.threshold))
+              + ", \"input\": " + jsonString(input) + ", \"runs\": [" + runs + "]"
+              + ", \"median\": " + std::to_string(summary.median) + ", \"stddev\": " + std::to_string(summary.stddev)
+              + ", \"threads\": " + std::to_string(point.threads) + ", \"threshold\": " + std::to_string(point.threshold)
+              + ", \"leaves\": " + std::to_string(point.leaves) + ", \"leafMs\": " + std::to_string(point.leafMs)
+              + ", \"mergeMs\": " + std::to_string(point.mergeMs) + ", \"finalMergeMs\": " + std::to_string(point.finalMergeMs) + "}";
+    }
+    return json + "\n]}\n";
+};
@@ -0,0 +1,385 @@
+#pragma once
+
+#include "functions.h"
+#include "MappedFile.h"
+#include <bit>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * Binary snapshot of an RBTree<std::string> (.rbs)
+ *
+ *   header   SnapshotHeader
+ *   nodes    SnapshotNode per node, children linked by index
+ *   strings  the words, back to back
+ *
+ * Links are indices instead of pointers, so a mapped snapshot can be searched
+ * and walked in place. Children are written before their parents, so every
+ * link points to a lower index. Opening a file only checks the header against
+ * the file size, so it costs the same for any size of tree; lookups and walks
+ * check every link and word they follow instead, so a corrupt file cannot
+ * lead them outside the mapping or around in a cycle. verifySnapshot checks
+ * every node up front, in O(n). thawSnapshot turns a snapshot back into a
+ * persistent tree with the same shape and colors, without comparing or
+ * rebalancing anything; it visits every node anyway, so it verifies first.
+ *
+ * Several versions of a tree (.rbm) share one node array and string area:
+ *
+ *   header   VersionsHeader
+ *   roots    uint32_t root node of every version
+ *   nodes    SnapshotNode per distinct node
+ *   strings  every distinct word once
+ *
+ * Subtrees that versions share through path copying are written once, so
+ * the file grows with the differences between versions, not their count.
+ * Opening the file and any one version in it is O(1) as well: a root is
+ * checked when its version is opened, the nodes as they are followed.
+ **/
+
+constexpr char SNAPSHOT_MAGIC[4] = {'R', 'B', 'S', '2'};
+constexpr char VERSIONS_MAGIC[4] = {'R', 'B', 'M', '2'};
+constexpr uint32_t NO_NODE = UINT32_MAX;
+
+struct SnapshotHeader {
+    char magic[4];
+    uint32_t root;
+    uint64_t nodeCount;
+    uint64_t stringBytes;
+};
+
+struct VersionsHeader {
+    char magic[4];
+    uint32_t versionCount;
+    uint64_t nodeCount;
+    uint64_t stringBytes;
+};
+
+struct SnapshotNode {
+    uint32_t left;
+    uint32_t right;
+    uint64_t value;
+    uint32_t length;
+    uint32_t color;
+};
+
+// One tree inside a mapped .rbs or .rbm file; all pointers point into the mapping
+struct TreeSnapshot {
+    Mapping file;
+    uint32_t root;
+    uint64_t nodeCount;
+    const SnapshotNode* nodes;
+    const char* strings;
+    uint64_t stringBytes;
+};
+
+// Collects nodes and words; with shared set, a node or word that was already written is reused.
+// A single tree has neither, so it is written without the lookups.
+template<class T>
+struct SnapshotWriter {
+    bool shared = false;
+    std::vector<SnapshotNode> nodes;
+    std::string strings;
+    std::unordered_map<const Node<T>*, uint32_t> written;
+    std::unordered_map<std::string, uint64_t> words;
+
+    uint32_t add(const RBTree<T>& t) {
+        if (isEmpty(t)) {
+            return NO_NODE;
+        }
+        if (shared) {
+            auto found = written.find(t.get());
+            if (found != written.end()) {
+                return found->second;
+            }
+        }
+
+        uint32_t lft = add(left(t));
+        uint32_t rgt = add(right(t));
+
+        uint64_t value = strings.size();
+        if (shared) {
+            auto [word, added] = words.try_emplace(root(t), value);
+            value = word->second;
+            if (added) {
+                strings.append(root(t));
+            }
+        } else {
+            strings.append(root(t));
+        }
+
+        uint32_t index = nodes.size();
+        nodes.push_back({lft, rgt, value, static_cast<uint32_t>(root(t).size()), rootColor(t)});
+        if (shared) {
+            written.emplace(t.get(), index);
+        }
+        return index;
+    }
+
+    void appendTo(std::string& file) const {
+        file.append(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(SnapshotNode));
+        file.append(strings);
+    }
+};
+
+auto encodeSnapshot = [](const auto& tree) {
+    SnapshotWriter<std::string> writer;
+    writer.nodes.reserve(treeSize(tree));
+    writer.strings.reserve(treeBytes(tree));
+
+    SnapshotHeader header{};
+    std::copy(std::begin(SNAPSHOT_MAGIC), std::end(SNAPSHOT_MAGIC), header.magic);
+    header.root = writer.add(tree);
+    header.nodeCount = writer.nodes.size();
+    header.stringBytes = writer.strings.size();
+
+    std::string file;
+    file.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    writer.appendTo(file);
+    return file;
+};
+
+auto encodeVersions = [](const auto& trees) {
+    SnapshotWriter<std::string> writer;
+    writer.shared = true;
+    std::vector<uint32_t> roots;
+    for (const auto& tree : trees) {
+        roots.push_back(writer.add(tree));
+    }
+
+    VersionsHeader header{};
+    std::copy(std::begin(VERSIONS_MAGIC), std::end(VERSIONS_MAGIC), header.magic);
+    header.versionCount = roots.size();
+    header.nodeCount = writer.nodes.size();
+    header.stringBytes = writer.strings.size();
+
+    std::string file;
+    file.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.append(reinterpret_cast<const char*>(roots.data()), roots.size() * sizeof(uint32_t));
+    file.append(file.size() % sizeof(uint64_t), '\0');
+    writer.appendTo(file);
+    return file;
+};
+
+auto saveSnapshot = [](const auto& tree) {
+    return [&tree](const char* filePath) {
+        return writeBuffer(encodeSnapshot(tree))(filePath);
+    };
+};
+
+auto saveVersions = [](const auto& trees) {
+    return [&trees](const char* filePath) {
+        return writeBuffer(encodeVersions(trees))(filePath);
+    };
+};
+
+// The longest path a red-black tree of nodeCount nodes can have
+inline size_t maxHeight(uint64_t nodeCount) {
+    return 2 * std::bit_width(nodeCount) + 1;
+}
+
+// Links only to lower indices, words inside the string area, colors R or B,
+// and no path longer than a red-black tree of nodeCount nodes can have
+inline bool validNodes(const SnapshotNode* nodes, uint64_t nodeCount, uint64_t stringBytes) {
+    size_t limit = maxHeight(nodeCount);
+    std::vector<uint8_t> heights(nodeCount);
+    auto height = [&heights](uint32_t child) { return child == NO_NODE ? 0 : heights[child]; };
+    for (uint64_t i = 0; i < nodeCount; ++i) {
+        const SnapshotNode& node = nodes[i];
+        if ((node.left != NO_NODE && node.left >= i) || (node.right != NO_NODE && node.right >= i)
+            || node.value > stringBytes || node.length > stringBytes - node.value
+            || (node.color != R && node.color != B)) {
+            return false;
+        }
+        size_t h = 1 + std::max(height(node.left), height(node.right));
+        if (h > limit) {
+            return false;
+        }
+        heights[i] = h;
+    }
+    return true;
+}
+
+auto openSnapshot = [](const std::string& filePath) -> Maybe<TreeSnapshot> {
+    Mapping file = mapFile(filePath);
+    if (!file || file->size < sizeof(SnapshotHeader)) {
+        return {std::nullopt};
+    }
+
+    auto header = reinterpret_cast<const SnapshotHeader*>(file->data);
+    size_t rest = file->size - sizeof(SnapshotHeader);
+    if (!std::equal(std::begin(SNAPSHOT_MAGIC), std::end(SNAPSHOT_MAGIC), header->magic)
+        || header->nodeCount > rest / sizeof(SnapshotNode)
+        || header->stringBytes != rest - header->nodeCount * sizeof(SnapshotNode)
+        || (header->root != NO_NODE && header->root >= header->nodeCount)) {
+        return {std::nullopt};
+    }
+
+    size_t nodeBytes = header->nodeCount * sizeof(SnapshotNode);
+    auto nodes = reinterpret_cast<const SnapshotNode*>(file->data + sizeof(SnapshotHeader));
+    return {TreeSnapshot{file, header->root, header->nodeCount, nodes,
+                         file->data + sizeof(SnapshotHeader) + nodeBytes, header->stringBytes}};
+};
+
+// Every node of the file, not only the ones reachable from this root; O(n)
+inline bool verifySnapshot(const TreeSnapshot& snapshot) {
+    return validNodes(snapshot.nodes, snapshot.nodeCount, snapshot.stringBytes);
+}
+
+// A mapped .rbm file
+struct TreeVersions {
+    Mapping file;
+    const VersionsHeader* header;
+    const uint32_t* roots;
+};
+
+auto openVersions = [](const std::string& filePath) -> Maybe<TreeVersions> {
+    Mapping file = mapFile(filePath);
+    if (!file || file->size < sizeof(VersionsHeader)) {
+        return {std::nullopt};
+    }
+
+    auto header = reinterpret_cast<const VersionsHeader*>(file->data);
+    size_t rootBytes = header->versionCount * sizeof(uint32_t);
+    // Keeps the node array 8-byte aligned for an odd number of versions
+    size_t padding = rootBytes % sizeof(uint64_t);
+    size_t rest = file->size - sizeof(VersionsHeader);
+    if (!std::equal(std::begin(VERSIONS_MAGIC), std::end(VERSIONS_MAGIC), header->magic)
+        || rootBytes + padding > rest
+        || header->nodeCount > (rest - rootBytes - padding) / sizeof(SnapshotNode)
+        || header->stringBytes != rest - rootBytes - padding - header->nodeCount * sizeof(SnapshotNode)) {
+        return {std::nullopt};
+    }
+
+    auto roots = reinterpret_cast<const uint32_t*>(file->data + sizeof(VersionsHeader));
+    return {TreeVersions{file, header, roots}};
+};
+
+inline uint32_t versionCount(const TreeVersions& versions) {
+    return versions.header->versionCount;
+}
+
+// Any version is one lookup in the root table away
+auto openVersion = [](const TreeVersions& versions) {
+    return [&versions](uint32_t version) -> Maybe<TreeSnapshot> {
+        uint32_t root = version < versions.header->versionCount ? versions.roots[version] : 0;
+        if (version >= versions.header->versionCount || (root != NO_NODE && root >= versions.header->nodeCount)) {
+            return {std::nullopt};
+        }
+        size_t rootBytes = versions.header->versionCount * sizeof(uint32_t);
+        const char* nodes = versions.file->data + sizeof(VersionsHeader) + rootBytes + rootBytes % sizeof(uint64_t);
+        return {TreeSnapshot{versions.file, root, versions.header->nodeCount,
+            reinterpret_cast<const SnapshotNode*>(nodes),
+            nodes + versions.header->nodeCount * sizeof(SnapshotNode), versions.header->stringBytes}};
+    };
+};
+
+inline std::string_view nodeValue(const TreeSnapshot& snapshot, uint32_t node) {
+    return std::string_view(snapshot.strings + snapshot.nodes[node].value, snapshot.nodes[node].length);
+}
+
+// A node reached from a node at index below (nodeCount for the root) at the given
+// depth: it has to lie lower, keep its word inside the string area and not be deeper
+// than any red-black tree of the file's size goes
+inline bool validStep(const TreeSnapshot& snapshot, uint32_t node, uint64_t below, size_t depth) {
+    if (node >= below || depth > maxHeight(snapshot.nodeCount)) {
+        return false;
+    }
+    const SnapshotNode& n = snapshot.nodes[node];
+    return n.value <= snapshot.stringBytes && n.length <= snapshot.stringBytes - n.value;
+}
+
+// A corrupt path reads as a missing word; verifySnapshot tells the two apart
+auto snapshotContains = [](const TreeSnapshot& snapshot) {
+    return [&snapshot](std::string_view word) {
+        uint32_t node = snapshot.root;
+        uint64_t below = snapshot.nodeCount;
+        for (size_t depth = 1; node != NO_NODE; ++depth) {
+            if (!validStep(snapshot, node, below, depth)) {
+                return false;
+            }
+            below = node;
+            std::string_view value = nodeValue(snapshot, node);
+            if (word < value) {
+                node = snapshot.nodes[node].left;
+            } else if (value < word) {
+                node = snapshot.nodes[node].right;
+            } else {
+                return true;
+            }
+        }
+        return false;
+    };
+};
+
+template<class F>
+bool forEachNode(const TreeSnapshot& snapshot, uint32_t node, uint64_t below, size_t depth, F& f) {
+    if (node == NO_NODE) {
+        return true;
+    }
+    if (!validStep(snapshot, node, below, depth)) {
+        return false;
+    }
+    if (!forEachNode(snapshot, snapshot.nodes[node].left, node, depth + 1, f)) {
+        return false;
+    }
+    f(nodeValue(snapshot, node));
+    return forEachNode(snapshot, snapshot.nodes[node].right, node, depth + 1, f);
+}
+
+// False if it stopped at a corrupt link, after the words before it
+template<class F>
+bool forEach(const TreeSnapshot& snapshot, F f) {
+    return forEachNode(snapshot, snapshot.root, snapshot.nodeCount, 1, f);
+}
+
+// thawed holds the nodes already rebuilt, so shared subtrees stay shared
+inline RBTree<std::string> thawNode(const TreeSnapshot& snapshot, uint32_t node, std::vector<RBTree<std::string>>& thawed) {
+    if (node == NO_NODE) {
+        return RBTree<std::string>();
+    }
+    if (thawed[node]) {
+        return thawed[node];
+    }
+    const SnapshotNode& n = snapshot.nodes[node];
+    thawed[node] = makeNode<std::string>(static_cast<Color>(n.color),
+        thawNode(snapshot, n.left, thawed),
+        std::string(nodeValue(snapshot, node)),
+        thawNode(snapshot, n.right, thawed));
+    return thawed[node];
+}
+
+// Rebuilds every node, O(n): thaw once and insert into the tree, not into the snapshot.
+// Nothing if any node is corrupt.
+auto thawSnapshot = [](const TreeSnapshot& snapshot) -> Maybe<RBTree<std::string>> {
+    if (!verifySnapshot(snapshot)) {
+        return {std::nullopt};
+    }
+    std::vector<RBTree<std::string>> thawed(snapshot.nodeCount);
+    return {thawNode(snapshot, snapshot.root, thawed)};
+};
+
+// Every root and every node of the file, O(n)
+inline bool verifyVersions(const TreeVersions& versions) {
+    for (uint32_t version = 0; version < versionCount(versions); ++version) {
+        if (!openVersion(versions)(version).valueType.has_value()) {
+            return false;
+        }
+    }
+    // All versions share one node array
+    return versionCount(versions) == 0 || verifySnapshot(openVersion(versions)(0).valueType.value());
+}
+
+// Nothing if any root or node is corrupt
+auto thawVersions = [](const TreeVersions& versions) -> Maybe<std::vector<RBTree<std::string>>> {
+    if (!verifyVersions(versions)) {
+        return {std::nullopt};
+    }
+    std::vector<RBTree<std::string>> thawed(versions.header->nodeCount);
+    std::vector<RBTree<std::string>> trees;
+    for (uint32_t version = 0; version < versionCount(versions); ++version) {
+        auto snapshot = openVersion(versions)(version);
+        trees.push_back(thawNode(snapshot.valueType.value(), snapshot.valueType.value().root, thawed));
+    }
+    return {trees};
+};
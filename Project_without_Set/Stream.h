@@ -0,0 +1,130 @@
+#pragma once
+
+#include "functions.h"
+#include "External.h"
+
+/**
+ * Streaming ingestion for inputs larger than memory
+ *
+ * The input is read in chunks of a fixed size. Text is only tokenized up to
+ * the last whitespace that cannot be part of a marker, the rest is carried
+ * into the next chunk, so markers and words split across chunk boundaries are
+ * still found whole. Besides the tree, memory stays at about two chunks, and
+ * with a memory budget the tree itself is spilled to sorted runs (External.h).
+ *
+ * Everything between the end of a start marker's line and the next end marker
+ * is read; after an end marker the next start marker is searched again, so
+ * concatenated books are handled one after the other.
+ **/
+
+constexpr size_t STREAM_CHUNK_SIZE = 1 << 20;
+
+struct StreamState {
+    enum Phase { Searching, StartLine, Body };
+
+    std::string startMarker;
+    std::string endMarker;
+    Phase phase;
+    std::string pending;
+    SpillingTree vocabulary;
+    size_t bytes = 0;
+    size_t chunkSize = STREAM_CHUNK_SIZE;  // read at a time
+};
+
+auto insertText = [](SpillingTree& vocabulary, const std::string& text) {
+    using namespace std::ranges;
+
+    auto words = insertIntoVector(filterText(text).valueType.value());
+    for (const auto& word : words | views::filter(filterInvalid)) {
+        vocabulary.add(word);
+    }
+};
+
+// Consumes as much of state.pending as can be decided on; at the end of input everything is
+inline void processPending(StreamState& state, bool final) {
+    std::string& pending = state.pending;
+    bool progress = true;
+    while (progress) {
+        progress = false;
+
+        if (state.phase == StreamState::Searching) {
+            auto pos = pending.find(state.startMarker);
+            if (pos == std::string::npos) {
+                // Only a partial marker at the very end can still matter
+                size_t keep = std::min(pending.size(), state.startMarker.size() - 1);
+                pending.erase(0, pending.size() - keep);
+                if (final) pending.clear();
+                return;
+            }
+            pending.erase(0, pos + state.startMarker.size());
+            state.phase = StreamState::StartLine;
+            progress = true;
+        }
+
+        if (state.phase == StreamState::StartLine) {
+            auto pos = pending.find('\n');
+            if (pos == std::string::npos) {
+                pending.clear();
+                return;
+            }
+            pending.erase(0, pos);
+            state.phase = StreamState::Body;
+            progress = true;
+        }
+
+        if (state.phase == StreamState::Body) {
+            auto pos = state.endMarker.empty() ? std::string::npos : pending.find(state.endMarker);
+            if (pos != std::string::npos) {
+                insertText(state.vocabulary, pending.substr(0, pos));
+                pending.erase(0, pos + state.endMarker.size());
+                state.phase = state.startMarker.empty() ? StreamState::Body : StreamState::Searching;
+                progress = true;
+                continue;
+            }
+            if (final) {
+                insertText(state.vocabulary, pending);
+                pending.clear();
+                return;
+            }
+
+            // Keep what could still be the start of an end marker, and cut at whitespace so no word is split
+            size_t safe = pending.size() - std::min(pending.size(), state.endMarker.size());
+            size_t cut = safe == 0 ? std::string::npos : pending.find_last_of(" \t\r\n", safe - 1);
+            if (cut == std::string::npos) {
+                // A single run without whitespace as long as the buffer is split anyway
+                cut = pending.size() > 2 * state.chunkSize ? safe : 0;
+            }
+            if (cut > 0) {
+                insertText(state.vocabulary, pending.substr(0, cut));
+                pending.erase(0, cut);
+            }
+        }
+    }
+}
+
+auto streamVocabulary = [](const std::string& startMarker) {
+    return [startMarker](const std::string& endMarker) {
+        return [startMarker, endMarker](const std::string& filePath, size_t chunkSize = STREAM_CHUNK_SIZE,
+                                        SpillingTree vocabulary = SpillingTree()) -> Maybe<StreamState> {
+            std::ifstream file(filePath, std::ios::binary);
+            if (!file) {
+                return {std::nullopt};
+            }
+
+            StreamState state;
+            state.startMarker = startMarker;
+            state.endMarker = endMarker;
+            state.phase = startMarker.empty() ? StreamState::Body : StreamState::Searching;
+            state.vocabulary = vocabulary;
+            state.chunkSize = std::max<size_t>(1, chunkSize);
+            std::string chunk(state.chunkSize, '\0');
+            while (file.read(chunk.data(), chunk.size()) || file.gcount() > 0) {
+                state.pending.append(chunk.data(), file.gcount());
+                state.bytes += file.gcount();
+                processPending(state, false);
+            }
+            processPending(state, true);
+            return {state};
+        };
+    };
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Trace of tasks, merges and pipeline stages
+ *
+ * While tracing is on, every TraceSpan records when it started and ended on
+ * which thread. writeTrace saves the spans in the Chrome trace-event format
+ * (complete "X" events, microseconds), which chrome://tracing and Perfetto
+ * open directly. Spans on the same thread nest by time. When tracing is
+ * off a span costs one relaxed load; -DDISABLE_PROFILING removes it.
+ **/
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    double start;     // microseconds since the recorder was created
+    double duration;
+    long thread;
+    size_t items;
+};
+
+struct TraceRecorder {
+    std::atomic<bool> enabled{false};
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::mutex lock;
+    std::vector<TraceEvent> events;
+
+    double now() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+    }
+};
+
+inline TraceRecorder TRACE;
+
+inline void startTrace() {
+    std::lock_guard<std::mutex> guard(TRACE.lock);
+    TRACE.events.clear();
+    TRACE.enabled = true;
+}
+
+inline void stopTrace() {
+    TRACE.enabled = false;
+}
+
+#ifndef DISABLE_PROFILING
+
+class TraceSpan {
+public:
+    TraceSpan(const char* name, const char* category, size_t items = 0)
+        : _name(name), _category(category), _items(items),
+          _recording(TRACE.enabled.load(std::memory_order_relaxed)), _start(_recording ? TRACE.now() : 0) {}
+
+    ~TraceSpan() {
+        if (!_recording) {
+            return;
+        }
+        double end = TRACE.now();
+        long thread = syscall(SYS_gettid);
+        std::lock_guard<std::mutex> guard(TRACE.lock);
+        TRACE.events.push_back({_name, _category, _start, end - _start, thread, _items});
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* _name;
+    const char* _category;
+    size_t _items;
+    bool _recording;
+    double _start;
+};
+
+#else
+
+class TraceSpan {
+public:
+    TraceSpan(const char*, const char*, size_t = 0) {}
+};
+
+#endif
+
+auto traceJson = []() {
+    std::lock_guard<std::mutex> guard(TRACE.lock);
+    std::string json = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    char line[256];
+    for (size_t i = 0; i < TRACE.events.size(); ++i) {
+        const TraceEvent& event = TRACE.events[i];
+        std::snprintf(line, sizeof(line),
+                      "%s\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %ld, \"args\": {\"items\": %zu}}",
+                      i ? "," : "", event.name, event.category, event.start, event.duration, getpid(), event.thread, event.items);
+        json += line;
+    }
+    json += "\n]}\n";
+    return json;
+};
+
+auto writeTrace = [](const char* filePath) {
+    std::string json = traceJson();
+    std::ofstream file(filePath, std::ios::binary);
+    return static_cast<bool>(file.write(json.data(), json.size()));
+};
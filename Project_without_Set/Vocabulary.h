@@ -0,0 +1,287 @@
+#pragma once
+
+#include "functions.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <string_view>
+
+/**
+ * Front-coded binary vocabulary (.fcv)
+ *
+ *   header   VocabularyHeader
+ *   index    uint64_t offset of every block, relative to the data section
+ *   data     blocks of up to blockSize words
+ *
+ * The first word of a block is stored whole (varint length, bytes) so the
+ * index can be binary searched without decoding. Every following word is
+ * stored as (varint shared prefix with the previous word, varint suffix
+ * length, suffix bytes). Integers are written in host (little-endian) order.
+ **/
+
+constexpr char VOCABULARY_MAGIC[4] = {'F', 'C', 'V', '1'};
+constexpr uint32_t VOCABULARY_BLOCK_SIZE = 16;
+
+struct VocabularyHeader {
+    char magic[4];
+    uint32_t blockSize;
+    uint64_t wordCount;
+    uint64_t blockCount;
+    uint64_t dataBytes;
+};
+
+inline void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline uint64_t getVarint(const char*& it) {
+    uint64_t value = 0;
+    int shift = 0;
+    while (static_cast<unsigned char>(*it) & 0x80) {
+        value |= static_cast<uint64_t>(*it++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(*it++)) << shift;
+    return value;
+}
+
+// As getVarint, but stops at end: a varint cut off there reads as UINT64_MAX
+inline uint64_t getVarint(const char*& it, const char* end) {
+    uint64_t value = 0;
+    for (int shift = 0; it < end && shift < 64; shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(*it++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    return UINT64_MAX;
+}
+
+// Accepts words in strictly ascending order and builds the whole file in memory.
+// A caller that streams the file takes data and offsets out as they fill up and
+// adds the bytes taken to flushed, so later offsets stay relative to the whole data section.
+struct FrontCoder {
+    uint32_t blockSize = VOCABULARY_BLOCK_SIZE;
+    uint64_t wordCount = 0;
+    bool sorted = true;
+    std::string previous;
+    std::vector<uint64_t> offsets;
+    std::string data;
+    uint64_t flushed = 0;
+
+    void add(std::string_view word) {
+        if (wordCount > 0 && !(previous < word)) {
+            sorted = false;
+        }
+
+        if (wordCount % blockSize == 0) {
+            offsets.push_back(flushed + data.size());
+            putVarint(data, word.size());
+            data.append(word);
+        } else {
+            size_t shared = 0;
+            size_t limit = std::min(previous.size(), word.size());
+            while (shared < limit && previous[shared] == word[shared]) {
+                ++shared;
+            }
+            putVarint(data, shared);
+            putVarint(data, word.size() - shared);
+            data.append(word.substr(shared));
+        }
+
+        previous.assign(word);
+        ++wordCount;
+    }
+
+    VocabularyHeader header() const {
+        VocabularyHeader header{};
+        std::copy(std::begin(VOCABULARY_MAGIC), std::end(VOCABULARY_MAGIC), header.magic);
+        header.blockSize = blockSize;
+        header.wordCount = wordCount;
+        header.blockCount = (wordCount + blockSize - 1) / blockSize;
+        header.dataBytes = flushed + data.size();
+        return header;
+    }
+
+    Maybe<std::string> finish() const {
+        if (!sorted) {
+            return {std::nullopt};
+        }
+
+        VocabularyHeader header = this->header();
+        std::string file;
+        file.reserve(sizeof(header) + offsets.size() * sizeof(uint64_t) + data.size());
+        file.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.append(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+        file.append(data);
+        return {file};
+    }
+};
+
+// A mapped .fcv file; all pointers point into the mapping
+struct Vocabulary {
+    Mapping file;
+    const VocabularyHeader* header;
+    const uint64_t* offsets;
+    const char* data;
+};
+
+auto encodeVocabulary = [](const auto& tree) -> Maybe<std::string> {
+    FrontCoder coder;
+    forEach(tree, [&coder](const auto& word) {
+        coder.add(word);
+    });
+    return coder.finish();
+};
+
+auto writeVocabulary = [](const auto& tree) {
+    return [&tree](const char* filePath) {
+        auto encoded = encodeVocabulary(tree);
+        return encoded.valueType.has_value() && writeBuffer(encoded.valueType.value())(filePath);
+    };
+};
+
+// Checks the header and every block offset, so reading a truncated or
+// corrupt file stays inside the mapping
+auto openVocabulary = [](const std::string& filePath) -> Maybe<Vocabulary> {
+    Mapping file = mapFile(filePath);
+    if (!file || file->size < sizeof(VocabularyHeader)) {
+        return {std::nullopt};
+    }
+
+    auto header = reinterpret_cast<const VocabularyHeader*>(file->data);
+    size_t rest = file->size - sizeof(VocabularyHeader);
+    if (!std::equal(std::begin(VOCABULARY_MAGIC), std::end(VOCABULARY_MAGIC), header->magic)
+        || header->blockSize == 0
+        || header->blockCount > rest / sizeof(uint64_t)
+        || header->dataBytes != rest - header->blockCount * sizeof(uint64_t)
+        || header->blockCount != header->wordCount / header->blockSize + (header->wordCount % header->blockSize != 0)) {
+        return {std::nullopt};
+    }
+
+    // Blocks start at 0, in order, and none is empty
+    auto offsets = reinterpret_cast<const uint64_t*>(file->data + sizeof(VocabularyHeader));
+    for (uint64_t block = 0; block < header->blockCount; ++block) {
+        uint64_t next = block + 1 < header->blockCount ? offsets[block + 1] : header->dataBytes;
+        if ((block == 0 && offsets[0] != 0) || offsets[block] >= next || next > header->dataBytes) {
+            return {std::nullopt};
+        }
+    }
+    return {Vocabulary{file, header, offsets, file->data + sizeof(VocabularyHeader) + header->blockCount * sizeof(uint64_t)}};
+};
+
+inline uint64_t wordCount(const Vocabulary& vocabulary) {
+    return vocabulary.header->wordCount;
+}
+
+inline const char* blockEnd(const Vocabulary& vocabulary, uint64_t block) {
+    return vocabulary.data + (block + 1 < vocabulary.header->blockCount ? vocabulary.offsets[block + 1]
+                                                                        : vocabulary.header->dataBytes);
+}
+
+inline std::string_view blockHead(const Vocabulary& vocabulary, uint64_t block) {
+    const char* it = vocabulary.data + vocabulary.offsets[block];
+    const char* end = blockEnd(vocabulary, block);
+    uint64_t length = getVarint(it, end);
+    return std::string_view(it, std::min<uint64_t>(length, end - it));
+}
+
+// Decodes one block, calling f with each word; f returns false to stop early
+template<class F>
+bool forEachInBlock(const Vocabulary& vocabulary, uint64_t block, F f) {
+    uint64_t first = block * vocabulary.header->blockSize;
+    uint64_t count = std::min<uint64_t>(vocabulary.header->blockSize, vocabulary.header->wordCount - first);
+
+    const char* it = vocabulary.data + vocabulary.offsets[block];
+    const char* end = blockEnd(vocabulary, block);
+    std::string word;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t shared = i == 0 ? 0 : getVarint(it, end);
+        uint64_t length = getVarint(it, end);
+        // A corrupt block ends the words early instead of reading past it
+        if (shared > word.size() || length > static_cast<uint64_t>(end - it)) {
+            return false;
+        }
+        word.resize(shared);
+        word.append(it, length);
+        it += length;
+        if (!f(std::string_view(word))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<class F>
+void forEachWord(const Vocabulary& vocabulary, F f) {
+    for (uint64_t block = 0; block < vocabulary.header->blockCount; ++block) {
+        forEachInBlock(vocabulary, block, [&f](std::string_view word) {
+            f(word);
+            return true;
+        });
+    }
+}
+
+auto containsWord = [](const Vocabulary& vocabulary) {
+    return [&vocabulary](std::string_view word) {
+        // Last block whose first word is <= word
+        uint64_t lo = 0;
+        uint64_t hi = vocabulary.header->blockCount;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (word < blockHead(vocabulary, mid)) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        if (lo == 0) {
+            return false;
+        }
+
+        bool found = false;
+        forEachInBlock(vocabulary, lo - 1, [&](std::string_view candidate) {
+            found = candidate == word;
+            return candidate < word;
+        });
+        return found;
+    };
+};
+
+// output.txt -> .fcv
+auto packVocabulary = [](const std::string& textPath) {
+    return [textPath](const char* binaryPath) {
+        Mapping text = mapFile(textPath);
+        if (!text) {
+            return false;
+        }
+
+        FrontCoder coder;
+        forEachLine(text, [&coder](std::string_view word) {
+            coder.add(word);
+        });
+        auto encoded = coder.finish();
+        return encoded.valueType.has_value() && writeBuffer(encoded.valueType.value())(binaryPath);
+    };
+};
+
+// .fcv -> output.txt
+auto unpackVocabulary = [](const std::string& binaryPath) {
+    return [binaryPath](const char* textPath) {
+        auto vocabulary = openVocabulary(binaryPath);
+        if (!vocabulary.valueType.has_value()) {
+            return false;
+        }
+
+        std::string buffer;
+        forEachWord(vocabulary.valueType.value(), [&buffer](std::string_view word) {
+            buffer.append(word);
+            buffer.push_back('\n');
+        });
+        return writeBuffer(buffer)(textPath);
+    };
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Zipf-distributed ranks and the keys they stand for
+ *
+ * ZipfSampler draws ranks 0 .. n-1 where rank r comes up in proportion to
+ * 1 / (r + 1)^s, the way word frequencies in natural text fall off. It keeps
+ * the cumulative weights, so one draw is a binary search. zipfKey turns a
+ * rank into a distinct upper-case key of a given length that does not sort
+ * by rank, so frequent keys end up all over the tree.
+ **/
+
+class ZipfSampler {
+public:
+    ZipfSampler(size_t n, double exponent = 1.0) : _cumulative(n) {
+        double total = 0;
+        for (size_t r = 0; r < n; ++r) {
+            total += 1.0 / std::pow(static_cast<double>(r + 1), exponent);
+            _cumulative[r] = total;
+        }
+        for (double& weight : _cumulative) {
+            weight /= total;
+        }
+    }
+
+    template<class Engine>
+    size_t operator()(Engine& engine) const {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(engine);
+        auto it = std::upper_bound(_cumulative.begin(), _cumulative.end(), u);
+        return std::min<size_t>(it - _cumulative.begin(), _cumulative.size() - 1);
+    }
+
+    size_t size() const {
+        return _cumulative.size();
+    }
+
+private:
+    std::vector<double> _cumulative;
+};
+
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+// Letters from a hash of the rank, then the rank in seven base-26 digits,
+// which keeps keys of ranks below 26^7 distinct; shorter keys hold fewer
+// digits and every key grows where its digits do not fit
+inline std::string zipfKey(uint64_t rank, size_t length) {
+    std::string digits;
+    for (uint64_t r = rank; r > 0 || digits.size() < std::min<size_t>(length, 7); r /= 26) {
+        digits.push_back('A' + r % 26);
+    }
+    std::string key;
+    uint64_t hash = splitmix64(rank);
+    while (key.size() + digits.size() < length) {
+        if (hash < 26) {
+            hash = splitmix64(hash + rank);
+        }
+        key.push_back('A' + hash % 26);
+        hash /= 26;
+    }
+    return key + digits;
+}
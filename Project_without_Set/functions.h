@@ -1,3 +1,5 @@
+#pragma once
+
 #include <iostream>
 #include <ranges>
 #include "RBTree.h"
@@ -8,6 +10,9 @@
 #include <chrono>
 #include <string_view>
 #include <algorithm>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
 
 template<typename T>
 struct Maybe {
@@ -44,8 +49,8 @@ auto isAlpha = [](const auto& character) {
 auto filterText = [](const auto& text) -> Maybe<std::string> {
     using namespace std::ranges;
 
-    auto transformed = views::iota(0, (int)text.size())
-        | views::transform([&](int index) {
+    auto transformed = views::iota(size_t{0}, text.size())
+        | views::transform([&](size_t index) {
             char c = text[index];
             if (isAlpha(c)) {
                 return c;
@@ -62,7 +67,10 @@ auto filterText = [](const auto& text) -> Maybe<std::string> {
         });
      
         
-    return {std::string(transformed.begin(), transformed.end())};
+    std::string result;
+    result.reserve(text.size());
+    copy(transformed, std::back_inserter(result));
+    return {result};
 };
 
 auto treeToVector = [](const auto& tree){
@@ -84,6 +92,106 @@ auto outPut = [](const auto& result) {
     };
 };
 
+auto outputSize = [](const auto& tree) {
+    return treeBytes(tree);
+};
+
+auto writeBuffer = [](const std::string& buffer) {
+    return [&buffer](const char* filePath) {
+        std::ofstream file(filePath, std::ios::binary);
+        if(!file){
+            std::cerr << "\nCould not open file\n";
+            return false;
+        }
+        return static_cast<bool>(file.write(buffer.data(), buffer.size()));
+    };
+};
+
+// Writes next to the target and renames, so a reader never sees half a file
+auto replaceFile = [](const std::string& buffer) {
+    return [&buffer](const std::string& filePath) {
+        std::string temporary = filePath + ".tmp";
+        return writeBuffer(buffer)(temporary.c_str()) && std::rename(temporary.c_str(), filePath.c_str()) == 0;
+    };
+};
+
+auto writeTree = [](const auto& tree) {
+    return [&tree](const char* filePath) {
+        std::string buffer;
+        buffer.reserve(outputSize(tree));
+        forEach(tree, [&buffer](const auto& word) {
+            buffer.append(word);
+            buffer.push_back('\n');
+        });
+        return writeBuffer(buffer)(filePath);
+    };
+};
+
+auto pwriteAll = [](int fd, const std::string& buffer, off_t offset) {
+    size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t n = pwrite(fd, buffer.data() + written, buffer.size() - written, offset + written);
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+};
+
+template<class T>
+std::function<bool(int, off_t, int)> parallelExport(const RBTree<T>& t) {
+    return [&t](int fd, off_t offset, int depth) -> bool {
+        if (depth <= 0 || treeSize(t) <= PARALLEL.threshold) {
+            // Serialize the whole subtree and write it at its final position
+            std::string buffer;
+            buffer.reserve(treeBytes(t));
+            forEach(t, [&buffer](const T& word) {
+                buffer.append(word);
+                buffer.push_back('\n');
+            });
+            return pwriteAll(fd, buffer, offset);
+        }
+
+        // Left subtree, root word and right subtree have known byte ranges
+        auto lft = left(t);
+        auto rgt = right(t);
+        off_t rootOffset = offset + treeBytes(lft);
+        off_t rightOffset = rootOffset + lineLength(root(t));
+
+        auto leftFuture = std::async(std::launch::async, [&]() {
+            return parallelExport(lft)(fd, offset, depth - 1);
+        });
+        bool rootWritten = pwriteAll(fd, root(t) + '\n', rootOffset);
+        bool rightWritten = parallelExport(rgt)(fd, rightOffset, depth - 1);
+
+        return leftFuture.get() && rootWritten && rightWritten;
+    };
+}
+
+auto parallelWriteTree = [](const auto& tree) {
+    return [&tree](const char* filePath) {
+        int fd = open(filePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            std::cerr << "\nCould not open file\n";
+            return false;
+        }
+
+        // One level of splitting per doubling of the thread count
+        unsigned threads = PARALLEL.threads ? PARALLEL.threads : std::max(1u, std::thread::hardware_concurrency());
+        int depth = 0;
+        while ((1u << depth) < threads) {
+            ++depth;
+        }
+
+        bool written = ftruncate(fd, treeBytes(tree)) == 0 && parallelExport(tree)(fd, 0, depth);
+        if (!written) {
+            std::cerr << "\nCould not write file\n";
+        }
+        return close(fd) == 0 && written;
+    };
+};
+
 auto readFileIntoString = [](const auto& filename) -> Maybe<std::string> {
     std::ifstream file(filename, std::ios::binary | std::ios::ate);
     if (!file) {
@@ -135,3 +243,33 @@ auto insertIntoStream = [](const auto& words){
 auto printTime = [](const auto& duration){
     std::cout << "Execution time: " << duration.count() << " ms" << std::endl;
 };
+
+auto optionValue = [](int argc, char* argv[]) {
+    return [argc, argv](const std::string& name) -> Maybe<std::string> {
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (name == argv[i]) {
+                return {std::string(argv[i + 1])};
+            }
+        }
+        return {std::nullopt};
+    };
+};
+
+auto hasOption = [](int argc, char* argv[]) {
+    return [argc, argv](const std::string& name) {
+        return std::any_of(argv + 1, argv + argc, [&name](const char* arg) { return name == arg; });
+    };
+};
+
+// "a,b,c" as {"a", "b", "c"}, for options that take lists
+auto splitList = [](const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+};
@@ -1,158 +1,228 @@
-#include <iostream>
-#include <ranges>
-#include "RBTree.h"
-#include <fstream>
-#include <sstream>
-#include <vector>
-#include <optional>
+#include "functions.h"
+#include "Snapshot.h"
+#include "Corpus.h"
+#include "Stream.h"
+#include "Incremental.h"
+#include "ChunkCache.h"
+#include "Profile.h"
+#include "Scaling.h"
 #include <chrono>
-#include <string_view>
-#include <algorithm>
 
-template<typename T>
-struct Maybe {
-    const std::optional<T> valueType;
+// main [--snapshot tree.rbs] [--chunk-cache directory] [--profile] [--profile-json profile.json] [--perf]
+//      [--trace trace.json] [--latency]
+// main --unique <directory of books>
+// main --corpus <directory of books | file listing books> [--per-book] [--reader sync|pread|uring] [--in-flight N]
+// main --stream <file> [--start marker] [--end marker] [--chunk-size bytes]
+//      [--memory-budget MB] [--spill-dir directory] [--out output.txt | output.fcv]
+// main --incremental <growing file> --state <path> [--start marker] [--end marker] [--new new_words.txt]
+// main --read-bench <directory of books | file listing books> [--in-flight N]
+// main --scaling <book> [--threads 1,2,4] [--thresholds 2500,10000] [--repetitions N] [--results scaling.json]
+int main(int argc, char* argv[]) {
+    using namespace std::ranges;
+    auto start = std::chrono::high_resolution_clock::now();
 
-    template<typename Func>
-    auto apply(const Func& func) -> decltype(func(valueType.value())) {
-        if (!valueType.has_value()) {
-            return {std::nullopt};
-        }
-        return func(valueType.value());
+    auto reader = parseReaderKind(optionValue(argc, argv)("--reader").valueType.value_or("sync"));
+    unsigned inFlight = std::stoul(optionValue(argc, argv)("--in-flight").valueType.value_or("8"));
+
+    auto readBenchSource = optionValue(argc, argv)("--read-bench");
+    if (readBenchSource.valueType.has_value()) {
+        readerBenchmark(readBenchSource.valueType.value())(inFlight);
+        return 0;
     }
-};
 
-auto trimText = [](const std::string& startMarker) {
-    return [startMarker](const std::string& endMarker) {
-        return [startMarker, endMarker](const std::string& text) -> Maybe<std::string> {
-            const auto start_pos = text.find(startMarker);
-            const auto end_pos = text.find(endMarker);
+    auto scalingSource = optionValue(argc, argv)("--scaling");
+    if (scalingSource.valueType.has_value()) {
+        auto option = optionValue(argc, argv);
+        auto text = readFileIntoString(scalingSource.valueType.value());
+        if (!text.valueType.has_value()) {
+            std::cerr << "\nCould not read " << scalingSource.valueType.value() << "\n";
+            return 1;
+        }
+        auto words = bookWords(text.valueType.value());
+        std::vector<unsigned> threads = threadCounts(std::thread::hardware_concurrency());
+        if (option("--threads").valueType.has_value()) {
+            threads.clear();
+            for (const auto& count : splitList(option("--threads").valueType.value())) {
+                threads.push_back(std::max(1ul, std::stoul(count)));
+            }
+        }
+        int repetitions = std::stoi(option("--repetitions").valueType.value_or("3"));
 
-            if (start_pos == std::string::npos || end_pos == std::string::npos || end_pos <= start_pos) {
-                return {std::nullopt};
+        std::vector<ScalingPoint> points;
+        for (const auto& threshold : splitList(option("--thresholds").valueType.value_or("2500,10000,40000,160000"))) {
+            for (unsigned count : threads) {
+                points.push_back(measureScaling(words)(count, std::stoull(threshold), repetitions));
             }
+        }
+        std::cout << words.size() << " words" << std::endl;
+        printScaling(points);
+        return writeBuffer(scalingJson(scalingSource.valueType.value(), points))
+                          (option("--results").valueType.value_or("scaling.json").c_str()) ? 0 : 1;
+    }
 
-            return {std::string{text}.substr(start_pos + startMarker.length(), end_pos - start_pos - startMarker.length())};
-        };
-    };
-};
+    auto streamPath = optionValue(argc, argv)("--stream");
+    if (streamPath.valueType.has_value()) {
+        auto option = optionValue(argc, argv);
+        SpillingTree vocabulary;
+        vocabulary.memoryBudget = std::stoull(option("--memory-budget").valueType.value_or("0")) << 20;
+        vocabulary.spillDirectory = option("--spill-dir").valueType.value_or(".");
+
+        auto state = streamVocabulary(option("--start").valueType.value_or("*** START OF"))
+                                     (option("--end").valueType.value_or("*** END OF"))
+                                     (streamPath.valueType.value(), std::stoull(option("--chunk-size").valueType.value_or(std::to_string(STREAM_CHUNK_SIZE))), vocabulary);
+        if (!state.valueType.has_value()) {
+            std::cerr << "\nCould not open file\n";
+            return 1;
+        }
+        SpillingTree result = state.valueType.value().vocabulary;
+        std::cout << "Sorted runs spilled: " << result.runs.size() << std::endl;
+        if (!result.finish(option("--out").valueType.value_or("output.txt"))) {
+            std::cerr << "\nCould not write output\n";
+            return 1;
+        }
+        printTime(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start));
+        return 0;
+    }
 
-auto isAlpha = [](const auto& character) {
-    return isalpha(character);
-};
+    auto incrementalPath = optionValue(argc, argv)("--incremental");
+    if (incrementalPath.valueType.has_value()) {
+        auto option = optionValue(argc, argv);
+        auto result = ingestAppended(option("--start").valueType.value_or("*** START OF"))
+                                    (option("--end").valueType.value_or("*** END OF"))
+                                    (incrementalPath.valueType.value(), option("--state").valueType.value_or(incrementalPath.valueType.value()),
+                                     std::stoul(option("--history").valueType.value_or(std::to_string(INCREMENTAL_HISTORY))));
+        if (!result.valueType.has_value()) {
+            std::cerr << "\nCould not ingest file\n";
+            return 1;
+        }
+        const auto& ingested = result.valueType.value();
+        parallelWriteTree(ingested.versions.back())("output.txt");
+        TextSink newWords(option("--new").valueType.value_or("new_words.txt").c_str());
+        for (const auto& word : ingested.added) {
+            newWords.add(word);
+        }
+        newWords.finish();
+        std::cout << "Read " << ingested.bytes << " new bytes, " << ingested.added.size() << " new words, "
+                  << ingested.versions.size() << " versions" << std::endl;
+        printTime(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start));
+        return 0;
+    }
 
-auto filterText = [](const auto& text) -> Maybe<std::string> {
-    using namespace std::ranges;
+    auto corpusSource = optionValue(argc, argv)("--corpus");
+    if (corpusSource.valueType.has_value()) {
+        corpusMode(corpusSource.valueType.value())(hasOption(argc, argv)("--per-book"), reader, inFlight);
+        printTime(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start));
+        return 0;
+    }
 
-    auto transformed = views::iota(0, (int)text.size())
-        | views::transform([&](int index) {
-            char c = text[index];
-            if (isAlpha(c)) {
-                return c;
-            }
-            else if (c == '\'' && index > 0 && index < text.size() - 1 && isAlpha(text[index - 1]) && isAlpha(text[index + 1])) {
-                return c;
-            }
-            else if (c == '-' && index > 0 && index < text.size() - 1 && isAlpha(text[index - 1]) && isAlpha(text[index + 1])) {
-                return c;
-            }
-            else {
-                return ' ';
-            }
-        });
-     
-        
-    return {std::string(transformed.begin(), transformed.end())};
-};
+    auto uniqueDirectory = optionValue(argc, argv)("--unique");
+    if (uniqueDirectory.valueType.has_value()) {
+        uniqueWordsMode(uniqueDirectory.valueType.value());
+        printTime(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start));
+        return 0;
+    }
 
-auto treeToVector = [](const auto& tree){
-    std::vector<std::string> result;
+    if (hasOption(argc, argv)("--perf")) {
+        std::cout << "Performance counters: " << enablePerfCounters().sourceName() << std::endl;
+    }
 
-    forEach(tree, [&](auto v) {
-        result.emplace_back(v);
+    auto tracePath = optionValue(argc, argv)("--trace");
+    if (tracePath.valueType.has_value()) {
+        startTrace();
+    }
+
+    bool latency = hasOption(argc, argv)("--latency");
+    recordLatencies(latency);
+
+    auto file = timedStage("read")([](StageTimer& timer) {
+        auto contents = readFileIntoString("war_and_peace.txt");
+        timer.count(1, contents.valueType ? contents.valueType->size() : 0);
+        return contents;
     });
-    return result;
-};
 
-auto outPut = [](const auto& result) {
-    return [&result](const char* filePath){
-        std::ofstream file(filePath);
-        if(!file){
-            std::cerr << "\nCould not open file\n";
-        }
-        file << result.rdbuf();
-    };
-};
-
-auto readFileIntoString = [](const auto& filename) -> Maybe<std::string> {
-    std::ifstream file(filename, std::ios::binary | std::ios::ate);
-    if (!file) {
-        return {std::nullopt};   
-    }
-    
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    std::string buffer(size, '\0');
-
-    if(file.read(&buffer[0], size)){
-        return {buffer};
-    } 
-        
-    return {std::nullopt};
-};
-
-auto str_toupper = [](const auto& s) {
-    std::string result = s;
-    std::transform(result.begin(), result.end(), result.begin(),
-                   [](unsigned char c) { return std::toupper(c); });
-    return result; 
-};
-
-auto filterInvalid = [](const auto& word){
-    return !((word.size() == 1 && (word != "A" && word != "I")) || word == "EPILOGUE") ;
-};
-
-auto insertIntoVector = [](const auto& text){
-    std::vector<std::string> nonfilteredwords;
-
-    std::istringstream stream(text);
-    std::string word;
-    while(stream >> word) {
-        nonfilteredwords.emplace_back(str_toupper(word));      
+    auto book = timedStage("trim")([&file](StageTimer& timer) {
+        auto trimmed = file.apply(trimText("CHAPTER 1")("*** END OF THE PROJECT GUTENBERG EBOOK, WAR AND PEACE ***"));
+        timer.count(1, trimmed.valueType ? trimmed.valueType->size() : 0);
+        return trimmed;
+    });
+
+    auto cacheDirectory = optionValue(argc, argv)("--chunk-cache");
+    if (cacheDirectory.valueType.has_value()) {
+        CachedBook cached = cachedVocabulary(cacheDirectory.valueType.value())(book.valueType.value_or(""));
+        parallelWriteTree(cached.vocabulary)("output.txt");
+        printChunkReport(cached.stats);
+        printTime(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start));
+        return 0;
     }
-    
-    return nonfilteredwords;
-};
 
-auto insertIntoStream = [](const auto& words){
-    std::ostringstream oss;
-    std::for_each(words.begin(), words.end(), [&oss](const auto& word){
-        oss << word << '\n';
+    std::string text = timedStage("filterText")([&book](StageTimer& timer) {
+        std::string filtered = book.apply(filterText).valueType.value_or("");
+        timer.count(1, filtered.size());
+        return filtered;
     });
-    return std::stringstream(oss.str());
-};
 
-auto printTime = [](const auto& duration){
-    std::cout << "Execution time: " << duration.count() << " ms" << std::endl;
-};
+    auto nonfilteredwords = timedStage("insertIntoVector")([&text](StageTimer& timer) {
+        auto words = insertIntoVector(text);
+        timer.count(words.size(), text.size());
+        return words;
+    });
 
-int main() {
-    using namespace std::ranges;
-    auto start = std::chrono::high_resolution_clock::now();
+    // Kept words are moved out once, instead of the filter running again on every split of parallelInsert
+    auto filteredWords = timedStage("filterInvalid")([&nonfilteredwords](StageTimer& timer) {
+        std::vector<std::string> words;
+        words.reserve(nonfilteredwords.size());
+        for (auto& word : nonfilteredwords | views::filter(filterInvalid)) {
+            words.push_back(std::move(word));
+        }
+        timer.count(words.size());
+        return words;
+    });
 
-    std::string text = readFileIntoString("war_and_peace.txt")
-                        .apply(trimText("CHAPTER 1")("*** END OF THE PROJECT GUTENBERG EBOOK, WAR AND PEACE ***"))
-                        .apply(filterText).valueType.value_or("");
-    
-    auto nonfilteredwords = insertIntoVector(text);
+    auto tree = timedStage("parallelInsert")([&filteredWords](StageTimer& timer) {
+        auto inserted = parallelInsert(RBTree<std::string>()) (filteredWords.begin(), filteredWords.end());
+        timer.count(filteredWords.size());
+        return inserted;
+    });
 
-    auto filteredWords = nonfilteredwords | views::filter(filterInvalid);
+    // Every token is looked up once, as an ingestion service checking for new words would
+    if (latency) {
+        timedStage("lookup")([&tree, &filteredWords](StageTimer& timer) {
+            size_t found = std::ranges::count_if(filteredWords, contains(tree));
+            timer.count(found);
+        });
+    }
+
+    timedStage("output")([&tree](StageTimer& timer) {
+        parallelWriteTree(tree)("output.txt");
+        timer.count(treeSize(tree), treeBytes(tree));
+    });
+
+    auto snapshotPath = optionValue(argc, argv)("--snapshot");
+    if (snapshotPath.valueType.has_value()) {
+        timedStage("snapshot")([&](StageTimer&) {
+            if (!saveSnapshot(tree)(snapshotPath.valueType.value().c_str())) {
+                std::cerr << "\nCould not write snapshot\n";
+            }
+        });
+    }
+
+    if (tracePath.valueType.has_value()) {
+        stopTrace();
+        writeTrace(tracePath.valueType.value().c_str());
+    }
+
+    // The default run prints nothing but the execution time
+    if (hasOption(argc, argv)("--profile") || hasOption(argc, argv)("--perf")) {
+        printProfile();
+    }
+    if (latency) {
+        printLatencies();
+    }
+    auto profilePath = optionValue(argc, argv)("--profile-json");
+    if (profilePath.valueType.has_value()) {
+        writeBuffer(profileJson())(profilePath.valueType.value().c_str());
+    }
 
-    auto tree = parallelInsert(RBTree<std::string>()) (filteredWords.begin(), filteredWords.end());
-    
-    outPut(insertIntoStream(treeToVector(tree)))("output.txt");
-    
     auto end = std::chrono::high_resolution_clock::now();
     
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
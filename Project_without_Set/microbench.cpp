@@ -0,0 +1,216 @@
+#include "RBTree.h"
+#include "Memory.h"
+#include "Zipf.h"
+#include "../Benchmark/Results.h"
+#include <chrono>
+#include <cstring>
+
+// microbench [--ops insert,ins,...] [--orders sorted,reverse,random,zipf] [--lengths 8,32]
+//            [--sizes 1000,100000] [--repetitions N] [--seed N] [--results microbench.json]
+//
+// Times the tree primitives on their own, without any text processing, and
+// reports the median ns/op over the repetitions with the allocations and
+// bytes allocated per operation. The allocation columns need a build with
+// -DTRACK_ALLOCATIONS and Memory.cpp, as microbenchBuild.bat does; without
+// them they stay 0.
+
+using Keys = std::vector<std::string>;
+using Tree = RBTree<std::string>;
+
+struct Case {
+    std::string op;
+    std::string order;
+    size_t length;
+    size_t size;
+};
+
+struct Sample {
+    double nanoseconds = 0;
+    size_t ops = 0;
+    size_t allocations = 0;
+    size_t bytes = 0;
+};
+
+// n keys in the given order; zipf draws n keys out of n distinct ones, so it has repeats like text
+auto makeKeys = [](const std::string& order, size_t length, size_t n, uint64_t seed, uint64_t firstRank = 0) -> Maybe<Keys> {
+    std::mt19937_64 engine(seed);
+    Keys keys;
+    keys.reserve(n);
+    if (order == "zipf") {
+        ZipfSampler sampler(n);
+        for (size_t i = 0; i < n; ++i) {
+            keys.push_back(zipfKey(firstRank + sampler(engine), length));
+        }
+        return {keys};
+    }
+    for (size_t i = 0; i < n; ++i) {
+        keys.push_back(zipfKey(firstRank + i, length));
+    }
+    if (order == "sorted") {
+        std::sort(keys.begin(), keys.end());
+    } else if (order == "reverse") {
+        std::sort(keys.rbegin(), keys.rend());
+    } else if (order == "random") {
+        std::shuffle(keys.begin(), keys.end(), engine);
+    } else {
+        return {std::nullopt};
+    }
+    return {keys};
+};
+
+inline Tree treeOf(Keys keys) {
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return fromSorted(keys);
+}
+
+// Times work(), which returns how many operations it did
+template<class F>
+Sample measure(F work) {
+    size_t allocations = ALLOCATIONS.allocations.load();
+    size_t bytes = ALLOCATIONS.bytes.load();
+    auto start = std::chrono::steady_clock::now();
+    size_t ops = work();
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return {elapsed, ops, ALLOCATIONS.allocations.load() - allocations, ALLOCATIONS.bytes.load() - bytes};
+}
+
+// One repetition of a case on keys; setup is done before measuring
+auto runCase = [](const Case& c, const Keys& keys, uint64_t seed) -> Maybe<Sample> {
+    if (c.op == "insert") {
+        return {measure([&] {
+            Tree t;
+            for (const auto& key : keys) {
+                t = insert(t)(key);
+            }
+            return keys.size();
+        })};
+    }
+    if (c.op == "ins") {
+        // Keys that are not in the tree yet, so every ins goes down to a leaf
+        Tree t = treeOf(keys);
+        Keys absent = makeKeys(c.order == "zipf" ? "random" : c.order, c.length, keys.size(), seed + 1, keys.size()).valueType.value();
+        return {measure([&] {
+            for (const auto& key : absent) {
+                Tree u = ins(t)(key);
+            }
+            return absent.size();
+        })};
+    }
+    if (c.op == "balance" || c.op == "paint") {
+        // A red node with a red left child per three keys: the case balance rotates
+        std::vector<Tree> doubled;
+        Keys largest;  // the key above each doubled subtree
+        for (size_t i = 0; i + 2 < keys.size(); i += 3) {
+            std::string k[3] = {keys[i], keys[i + 1], keys[i + 2]};
+            std::sort(k, k + 3);
+            Tree leaf = makeNode<std::string>(R, Tree(), k[0], Tree());
+            doubled.push_back(makeNode<std::string>(R, leaf, k[1], Tree()));
+            largest.push_back(k[2]);
+        }
+        if (c.op == "paint") {
+            return {measure([&] {
+                for (const auto& t : doubled) {
+                    Tree u = paintBlack<std::string>(t);
+                }
+                return doubled.size();
+            })};
+        }
+        return {measure([&] {
+            for (size_t i = 0; i < doubled.size(); ++i) {
+                Tree u = balance<std::string>(B)(doubled[i])(largest[i])(Tree());
+            }
+            return doubled.size();
+        })};
+    }
+    if (c.op == "forEach") {
+        Tree t = treeOf(keys);
+        return {measure([&] {
+            size_t bytes = 0;
+            forEach(t, [&bytes](const std::string& key) { bytes += key.size(); });
+            volatile size_t sink = bytes;
+            (void)sink;
+            return treeSize(t);
+        })};
+    }
+    if (c.op == "merge") {
+        // Each half inserted in its own order, as parallelInsert's halves are
+        auto mid = keys.begin() + keys.size() / 2;
+        Tree left = inserted(Tree())(keys.begin(), mid);
+        Tree right = inserted(Tree())(mid, keys.end());
+        return {measure([&] {
+            Tree t = merge(left)(right);
+            return treeSize(right);
+        })};
+    }
+    if (c.op == "parallelInsert") {
+        return {measure([&] {
+            Tree t = parallelInsert(Tree())(keys.begin(), keys.end());
+            return keys.size();
+        })};
+    }
+    return {std::nullopt};
+};
+
+auto sampleJson = [](const Case& c, const std::vector<double>& nsPerOp, double allocationsPerOp, double bytesPerOp) {
+    Summary summary = summarize(nsPerOp);
+    std::string runs;
+    for (size_t i = 0; i < nsPerOp.size(); ++i) {
+        runs += (i ? ", " : "") + std::to_string(nsPerOp[i]);
+    }
+    return "{\"engine\": " + jsonString(c.op)
+         + ", \"input\": " + jsonString(c.order + "/" + std::to_string(c.length) + "/" + std::to_string(c.size))
+         + ", \"unit\": \"ns/op\", \"runs\": [" + runs + "]"
+         + ", \"median\": " + std::to_string(summary.median) + ", \"stddev\": " + std::to_string(summary.stddev)
+         + ", \"allocsPerOp\": " + std::to_string(allocationsPerOp) + ", \"bytesPerOp\": " + std::to_string(bytesPerOp) + "}";
+};
+
+int main(int argc, char* argv[]) {
+    auto option = optionValue(argc, argv);
+    auto ops = splitList(option("--ops").valueType.value_or("insert,ins,balance,paint,forEach,merge,parallelInsert"));
+    auto orders = splitList(option("--orders").valueType.value_or("sorted,reverse,random,zipf"));
+    auto lengths = splitList(option("--lengths").valueType.value_or("8,32"));
+    auto sizes = splitList(option("--sizes").valueType.value_or("1000,100000"));
+    int repetitions = std::stoi(option("--repetitions").valueType.value_or("5"));
+    uint64_t seed = std::stoull(option("--seed").valueType.value_or("1"));
+    std::string resultsPath = option("--results").valueType.value_or("microbench.json");
+
+    std::string json = "{\"machine\": {\"cores\": " + std::to_string(std::thread::hardware_concurrency())
+                     + "},\n \"measurements\": [";
+    size_t written = 0;
+    std::printf("%-15s %-8s %6s %8s %10s %10s %10s %10s\n", "op", "order", "length", "size", "ns/op", "stddev", "allocs/op", "bytes/op");
+    for (const auto& order : orders) {
+        for (const auto& length : lengths) {
+            for (const auto& size : sizes) {
+                auto keys = makeKeys(order, std::stoul(length), std::stoul(size), seed);
+                if (!keys.valueType.has_value()) {
+                    std::cerr << "\nUnknown order " << order << "\n";
+                    return 1;
+                }
+                for (const auto& op : ops) {
+                    Case c{op, order, std::stoul(length), std::stoul(size)};
+                    std::vector<double> nsPerOp;
+                    Sample last;
+                    for (int i = 0; i < repetitions; ++i) {
+                        auto sample = runCase(c, keys.valueType.value(), seed);
+                        if (!sample.valueType.has_value()) {
+                            std::cerr << "\nUnknown op " << op << "\n";
+                            return 1;
+                        }
+                        last = sample.valueType.value();
+                        nsPerOp.push_back(last.nanoseconds / std::max<size_t>(last.ops, 1));
+                    }
+                    double allocationsPerOp = static_cast<double>(last.allocations) / std::max<size_t>(last.ops, 1);
+                    double bytesPerOp = static_cast<double>(last.bytes) / std::max<size_t>(last.ops, 1);
+                    Summary summary = summarize(nsPerOp);
+                    std::printf("%-15s %-8s %6zu %8zu %10.1f %10.1f %10.2f %10.1f\n", op.c_str(), order.c_str(), c.length,
+                                c.size, summary.median, summary.stddev, allocationsPerOp, bytesPerOp);
+                    std::fflush(stdout);
+                    json += (written++ ? ",\n" : "\n") + sampleJson(c, nsPerOp, allocationsPerOp, bytesPerOp);
+                }
+            }
+        }
+    }
+    json += "\n]}\n";
+    return writeBuffer(json)(resultsPath.c_str()) ? 0 : 1;
+}
@@ -0,0 +1,6 @@
+@echo off
+
+mkdir buildG++
+pushd buildG++
+wsl g++ -std=c++20 -DTRACK_ALLOCATIONS ../microbench.cpp ../Memory.cpp -o microbench -O2 -pthread
+popd buildG++
\ No newline at end of file
@@ -0,0 +1,6 @@
+@echo off
+
+mkdir buildG++
+pushd buildG++
+wsl g++ -std=c++20 -DTRACK_ALLOCATIONS ../main.cpp ../Memory.cpp -o mainProfile -Ofast
+popd buildG++
\ No newline at end of file
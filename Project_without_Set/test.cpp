@@ -1,7 +1,23 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 #include <iostream>
+#include <cstring>
+#include <map>
+#include <set>
 #include "functions.h"
+#include "Vocabulary.h"
+#include "Automaton.h"
+#include "Snapshot.h"
+#include "Corpus.h"
+#include "Stream.h"
+#include "Merge.h"
+#include "Incremental.h"
+#include "ChunkCache.h"
+#include "Profile.h"
+#include "Trace.h"
+#include "Histogram.h"
+#include "Zipf.h"
+#include "Scaling.h"
 
 TEST_CASE("Testing trimText function") {
     auto trim = trimText("start")("end");
@@ -150,6 +166,86 @@ DOCTEST_TEST_CASE("Test outPut with empty stringstream") {
     std::remove(filePath);
 }
 
+TEST_CASE("Test outputSize function") {
+    SUBCASE("Counts one newline per word") {
+        std::vector<std::string> words = {"b", "apple", "cc"};
+        RBTree<std::string> tree = inserted(RBTree<std::string>())(words.begin(), words.end());
+        CHECK(outputSize(tree) == 11);
+    }
+
+    SUBCASE("Empty tree") {
+        RBTree<std::string> emptyTree;
+        CHECK(outputSize(emptyTree) == 0);
+    }
+}
+
+TEST_CASE("Test writeTree function") {
+    std::vector<std::string> words = {"banana", "apple", "orange"};
+    RBTree<std::string> tree = inserted(RBTree<std::string>())(words.begin(), words.end());
+
+    const char* streamPath = "stream_test_output.txt";
+    const char* treePath = "tree_test_output.txt";
+    outPut(insertIntoStream(treeToVector(tree)))(streamPath);
+    writeTree(tree)(treePath);
+
+    auto expected = readFileIntoString(streamPath);
+    auto written = readFileIntoString(treePath);
+
+    REQUIRE(written.valueType.has_value());
+    CHECK(written.valueType.value() == "apple\nbanana\norange\n");
+    CHECK(written.valueType.value() == expected.valueType.value());
+    std::remove(streamPath);
+    std::remove(treePath);
+}
+
+TEST_CASE("Test parallelWriteTree function") {
+    std::vector<std::string> words;
+    for (int i = 0; i < 25000; ++i) {
+        words.emplace_back("W" + std::to_string(i * 7919 % 25000));
+    }
+    RBTree<std::string> tree = parallelInsert(RBTree<std::string>())(words.begin(), words.end());
+
+    const char* serialPath = "serial_test_output.txt";
+    const char* parallelPath = "parallel_test_output.txt";
+    REQUIRE(writeTree(tree)(serialPath));
+    REQUIRE(parallelWriteTree(tree)(parallelPath));
+
+    auto expected = readFileIntoString(serialPath);
+    auto written = readFileIntoString(parallelPath);
+
+    REQUIRE(written.valueType.has_value());
+    CHECK(written.valueType.value().size() == treeBytes(tree));
+    CHECK(written.valueType.value() == expected.valueType.value());
+
+    SUBCASE("Forced split depth") {
+        int fd = open(parallelPath, O_WRONLY | O_TRUNC);
+        REQUIRE(fd >= 0);
+        CHECK(parallelExport(tree)(fd, 0, 3));
+        close(fd);
+        CHECK(readFileIntoString(parallelPath).valueType.value() == expected.valueType.value());
+    }
+
+    SUBCASE("Split threshold follows PARALLEL") {
+        PARALLEL = {100, 0};
+        int fd = open(parallelPath, O_WRONLY | O_TRUNC);
+        REQUIRE(fd >= 0);
+        CHECK(parallelExport(tree)(fd, 0, 8));
+        close(fd);
+        PARALLEL = ParallelSettings();
+        CHECK(readFileIntoString(parallelPath).valueType.value() == expected.valueType.value());
+    }
+
+    SUBCASE("Failures are reported") {
+        CHECK_FALSE(parallelWriteTree(tree)("no_such_directory/output.txt"));
+        SpillingTree vocabulary;
+        vocabulary.tree = tree;
+        CHECK_FALSE(vocabulary.finish("no_such_directory/output.txt"));
+    }
+
+    std::remove(serialPath);
+    std::remove(parallelPath);
+}
+
 TEST_CASE("Test readFileIntoString function") {
     
     SUBCASE("Non-existent file") {
@@ -263,6 +359,28 @@ TEST_CASE("Test Node creation") {
     }
 }
 
+TEST_CASE("Test treeSize and treeBytes functions") {
+    SUBCASE("Empty tree") {
+        RBTree<std::string> emptyTree;
+        CHECK(treeSize(emptyTree) == 0);
+        CHECK(treeBytes(emptyTree) == 0);
+    }
+
+    SUBCASE("Counts survive rebalancing") {
+        std::vector<std::string> words = {"e", "d", "c", "b", "a", "ab"};
+        RBTree<std::string> tree = inserted(RBTree<std::string>())(words.begin(), words.end());
+        CHECK(treeSize(tree) == 6);
+        CHECK(treeBytes(tree) == 13);
+        CHECK(treeSize(left(tree)) + treeSize(right(tree)) == 5);
+    }
+
+    SUBCASE("Duplicates are not counted") {
+        RBTree<std::string> tree = insert(RBTree<std::string>())("a");
+        tree = insert(tree)("a");
+        CHECK(treeSize(tree) == 1);
+    }
+}
+
 TEST_CASE("Test rootColor function") {
     SUBCASE("Test rootColor with Black root") {
         RBTree<int> root = std::make_shared<Node<int>>(Color::B, nullptr, 10, nullptr);
@@ -440,4 +558,1332 @@ TEST_CASE("Test parallelInsert function") {
 
     CHECK(insertedElements.size() == 4);
     CHECK(insertedElements == std::vector<std::string>{"apple", "banana", "cherry", "date"});
-}
\ No newline at end of file
+}
+
+/** 
+ * 
+ *  ---------------------------------------- VOCABULARY TESTS -----------------------------------
+ * 
+ **/
+
+TEST_CASE("Test varint encoding") {
+    std::string buffer;
+    putVarint(buffer, 0);
+    putVarint(buffer, 127);
+    putVarint(buffer, 300);
+    putVarint(buffer, 1ull << 40);
+
+    CHECK(buffer.size() == 1 + 1 + 2 + 6);
+
+    const char* it = buffer.data();
+    CHECK(getVarint(it) == 0);
+    CHECK(getVarint(it) == 127);
+    CHECK(getVarint(it) == 300);
+    CHECK(getVarint(it) == 1ull << 40);
+}
+
+TEST_CASE("Test front-coded vocabulary") {
+    std::vector<std::string> words;
+    for (int i = 0; i < 100; ++i) {
+        words.emplace_back("WORD" + std::to_string(i));
+    }
+    words.emplace_back("A");
+    words.emplace_back("ZEBRA");
+    RBTree<std::string> tree = inserted(RBTree<std::string>())(words.begin(), words.end());
+
+    const char* binaryPath = "vocabulary_test.fcv";
+    REQUIRE(writeVocabulary(tree)(binaryPath));
+
+    auto vocabulary = openVocabulary(binaryPath);
+    REQUIRE(vocabulary.valueType.has_value());
+    const Vocabulary& v = vocabulary.valueType.value();
+
+    SUBCASE("Header and order") {
+        CHECK(wordCount(v) == treeSize(tree));
+        CHECK(v.header->blockCount == (treeSize(tree) + VOCABULARY_BLOCK_SIZE - 1) / VOCABULARY_BLOCK_SIZE);
+
+        std::vector<std::string> decoded;
+        forEachWord(v, [&](std::string_view word) { decoded.emplace_back(word); });
+        CHECK(decoded == treeToVector(tree));
+    }
+
+    SUBCASE("Lookup") {
+        CHECK(containsWord(v)("A"));
+        CHECK(containsWord(v)("WORD57"));
+        CHECK(containsWord(v)("ZEBRA"));
+        CHECK_FALSE(containsWord(v)(""));
+        CHECK_FALSE(containsWord(v)("WORD"));
+        CHECK_FALSE(containsWord(v)("WORD570"));
+        CHECK_FALSE(containsWord(v)("ZZZ"));
+    }
+
+    SUBCASE("Text round trip") {
+        const char* textPath = "vocabulary_test.txt";
+        const char* unpackedPath = "vocabulary_unpacked.txt";
+        const char* repackedPath = "vocabulary_repacked.fcv";
+        writeTree(tree)(textPath);
+
+        CHECK(unpackVocabulary(binaryPath)(unpackedPath));
+        CHECK(readFileIntoString(unpackedPath).valueType.value() == readFileIntoString(textPath).valueType.value());
+
+        CHECK(packVocabulary(textPath)(repackedPath));
+        CHECK(readFileIntoString(repackedPath).valueType.value() == readFileIntoString(binaryPath).valueType.value());
+
+        std::remove(textPath);
+        std::remove(unpackedPath);
+        std::remove(repackedPath);
+    }
+
+    std::remove(binaryPath);
+}
+
+TEST_CASE("Test invalid vocabulary input") {
+    SUBCASE("Unsorted words are rejected") {
+        FrontCoder coder;
+        coder.add("B");
+        coder.add("A");
+        CHECK_FALSE(coder.finish().valueType.has_value());
+    }
+
+    SUBCASE("Not a vocabulary file") {
+        const char* filePath = "not_a_vocabulary.fcv";
+        std::ofstream(filePath) << "definitely not a vocabulary file header";
+        CHECK_FALSE(openVocabulary(filePath).valueType.has_value());
+        CHECK_FALSE(openVocabulary("non_existent_file.fcv").valueType.has_value());
+        std::remove(filePath);
+    }
+
+    SUBCASE("Corrupt headers and offsets are rejected") {
+        FrontCoder coder;
+        for (int i = 10; i < 60; ++i) {
+            coder.add("WORD" + std::to_string(i));
+        }
+        const std::string valid = coder.finish().valueType.value();
+        const char* filePath = "corrupt_vocabulary.fcv";
+        auto opens = [filePath](const std::string& contents) {
+            writeBuffer(contents)(filePath);
+            return openVocabulary(filePath).valueType.has_value();
+        };
+        auto header = [&valid](auto change) {
+            std::string contents = valid;
+            change(*reinterpret_cast<VocabularyHeader*>(contents.data()));
+            return contents;
+        };
+        auto offset = [&valid](size_t block, uint64_t value) {
+            std::string contents = valid;
+            std::memcpy(contents.data() + sizeof(VocabularyHeader) + block * sizeof(uint64_t), &value, sizeof(value));
+            return contents;
+        };
+
+        CHECK(opens(valid));
+        CHECK_FALSE(opens(valid.substr(0, valid.size() - 1)));
+        CHECK_FALSE(opens(header([](VocabularyHeader& h) { h.blockSize = 0; })));
+        CHECK_FALSE(opens(header([](VocabularyHeader& h) { h.wordCount = 1000; })));
+        CHECK_FALSE(opens(header([](VocabularyHeader& h) { h.wordCount = 1; })));
+        CHECK_FALSE(opens(header([](VocabularyHeader& h) { h.blockCount = UINT64_MAX / 4; })));
+        CHECK_FALSE(opens(offset(0, 1)));
+        CHECK_FALSE(opens(offset(2, 1u << 20)));
+        CHECK_FALSE(opens(offset(3, 0)));
+
+        // A damaged word inside a block stops decoding at the block's end
+        std::string damaged = valid;
+        size_t data = sizeof(VocabularyHeader) + 4 * sizeof(uint64_t);
+        std::fill(damaged.begin() + data + 8, damaged.begin() + data + 20, '\xff');
+        REQUIRE(opens(damaged));
+        auto vocabulary = openVocabulary(filePath);
+        size_t words = 0;
+        forEachWord(vocabulary.valueType.value(), [&words](std::string_view) { ++words; });
+        CHECK(words < 50);
+        containsWord(vocabulary.valueType.value())("WORD12");
+        std::remove(filePath);
+    }
+}
+
+TEST_CASE("Test minimal automaton") {
+    std::vector<std::string> words = {"TOPS", "TAP", "TOP", "TAPS", "TAPE", "TOPE", "A"};
+    RBTree<std::string> tree = inserted(RBTree<std::string>())(words.begin(), words.end());
+
+    const char* filePath = "automaton_test.dawg";
+    REQUIRE(writeAutomaton(tree)(filePath));
+
+    auto automaton = openAutomaton(filePath);
+    REQUIRE(automaton.valueType.has_value());
+    const Automaton& a = automaton.valueType.value();
+
+    SUBCASE("Shared suffixes are stored once") {
+        // A | T -> {A, O} -> P -> {E, S}; TAP and TOP share everything after the vowel
+        CHECK(a.header->wordCount == 7);
+        CHECK(a.header->arcCount == 7);
+    }
+
+    SUBCASE("Exact lookup") {
+        for (const auto& word : words) {
+            CHECK(acceptsWord(a)(word));
+        }
+        CHECK_FALSE(acceptsWord(a)(""));
+        CHECK_FALSE(acceptsWord(a)("T"));
+        CHECK_FALSE(acceptsWord(a)("TOPES"));
+        CHECK_FALSE(acceptsWord(a)("TOPSY"));
+        CHECK_FALSE(acceptsWord(a)("B"));
+    }
+
+    SUBCASE("Prefix enumeration") {
+        std::vector<std::string> found;
+        forEachWithPrefix(a, "TA", [&](std::string_view word) { found.emplace_back(word); });
+        CHECK(found == std::vector<std::string>{"TAP", "TAPE", "TAPS"});
+
+        found.clear();
+        forEachWithPrefix(a, "", [&](std::string_view word) { found.emplace_back(word); });
+        CHECK(found == treeToVector(tree));
+
+        found.clear();
+        forEachWithPrefix(a, "X", [&](std::string_view word) { found.emplace_back(word); });
+        CHECK(found.empty());
+    }
+
+    SUBCASE("Corrupt roots, targets and states are rejected") {
+        // Arcs 0-1: E, S; 2: P; 3-4: A, O; 5-6: the root's A and T
+        const std::string valid = encodeAutomaton(tree).valueType.value();
+        const char* corruptPath = "corrupt_automaton_test.dawg";
+        auto opens = [corruptPath](const std::string& contents) {
+            writeBuffer(contents)(corruptPath);
+            return openAutomaton(corruptPath).valueType.has_value();
+        };
+        auto header = [&valid](auto change) {
+            std::string contents = valid;
+            change(*reinterpret_cast<AutomatonHeader*>(contents.data()));
+            return contents;
+        };
+        auto arc = [&valid](size_t index, auto change) {
+            std::string contents = valid;
+            uint32_t& target = reinterpret_cast<uint32_t*>(contents.data() + sizeof(AutomatonHeader))[index];
+            target = change(target);
+            return contents;
+        };
+        auto retarget = [](uint32_t state) { return [state](uint32_t t) { return (t & ~NO_STATE) | state; }; };
+
+        CHECK(opens(valid));
+        CHECK_FALSE(opens(valid.substr(0, valid.size() - 1)));
+        CHECK_FALSE(opens(header([](AutomatonHeader& h) { h.arcCount = UINT64_MAX / 5 + 2; })));
+        CHECK_FALSE(opens(header([](AutomatonHeader& h) { h.root = 7; })));
+        // Arc 4 is in the middle of a state
+        CHECK_FALSE(opens(header([](AutomatonHeader& h) { h.root = 4; })));
+        CHECK_FALSE(opens(arc(6, retarget(4))));
+        // A target at or after its own state is out of range or a cycle
+        CHECK_FALSE(opens(arc(2, retarget(2))));
+        CHECK_FALSE(opens(arc(0, retarget(5))));
+        CHECK_FALSE(opens(arc(6, [](uint32_t t) { return t & ~LAST_ARC; })));
+        std::remove(corruptPath);
+    }
+
+    std::remove(filePath);
+}
+
+TEST_CASE("Test automaton against the vocabulary") {
+    std::vector<std::string> words;
+    for (int i = 0; i < 3000; ++i) {
+        words.emplace_back(std::to_string(i * 7919 % 5000) + "X");
+    }
+    RBTree<std::string> tree = inserted(RBTree<std::string>())(words.begin(), words.end());
+
+    const char* textPath = "automaton_test.txt";
+    const char* filePath = "automaton_text_test.dawg";
+    writeTree(tree)(textPath);
+    REQUIRE(buildAutomaton(textPath)(filePath));
+
+    auto automaton = openAutomaton(filePath);
+    REQUIRE(automaton.valueType.has_value());
+
+    std::vector<std::string> found;
+    forEachWithPrefix(automaton.valueType.value(), "", [&](std::string_view word) { found.emplace_back(word); });
+    CHECK(found == treeToVector(tree));
+    CHECK_FALSE(acceptsWord(automaton.valueType.value())("5000X"));
+
+    std::remove(textPath);
+    std::remove(filePath);
+}
+
+TEST_CASE("Test tree snapshot") {
+    std::vector<std::string> words;
+    for (int i = 0; i < 500; ++i) {
+        words.emplace_back("W" + std::to_string(i * 7919 % 1000));
+    }
+    RBTree<std::string> tree = inserted(RBTree<std::string>())(words.begin(), words.end());
+
+    const char* filePath = "snapshot_test.rbs";
+    REQUIRE(saveSnapshot(tree)(filePath));
+
+    auto snapshot = openSnapshot(filePath);
+    REQUIRE(snapshot.valueType.has_value());
+    const TreeSnapshot& s = snapshot.valueType.value();
+
+    SUBCASE("Queried in place") {
+        CHECK(s.nodeCount == treeSize(tree));
+        for (const auto& word : words) {
+            CHECK(snapshotContains(s)(word));
+        }
+        CHECK_FALSE(snapshotContains(s)("W1000"));
+        CHECK_FALSE(snapshotContains(s)(""));
+
+        std::vector<std::string> walked;
+        forEach(s, [&](std::string_view word) { walked.emplace_back(word); });
+        CHECK(walked == treeToVector(tree));
+    }
+
+    SUBCASE("Thawed tree keeps shape and colors") {
+        CHECK(verifySnapshot(s));
+        auto thawedSnapshot = thawSnapshot(s);
+        REQUIRE(thawedSnapshot.valueType.has_value());
+        RBTree<std::string> thawed = thawedSnapshot.valueType.value();
+        CHECK(encodeSnapshot(thawed) == encodeSnapshot(tree));
+        CHECK(treeBytes(thawed) == treeBytes(tree));
+    }
+
+    SUBCASE("Corrupt links and words are rejected") {
+        const std::string valid = encodeSnapshot(tree);
+        const char* corruptPath = "corrupt_snapshot_test.rbs";
+        auto opens = [corruptPath](const std::string& contents) {
+            writeBuffer(contents)(corruptPath);
+            return openSnapshot(corruptPath).valueType.has_value();
+        };
+        // Opening only checks the header; lookups and walks check what they follow,
+        // verifySnapshot and thawSnapshot check every node
+        auto verifies = [corruptPath, &words](const std::string& contents) {
+            writeBuffer(contents)(corruptPath);
+            auto opened = openSnapshot(corruptPath);
+            REQUIRE(opened.valueType.has_value());
+            const TreeSnapshot& corrupt = opened.valueType.value();
+            for (const auto& word : words) {
+                snapshotContains(corrupt)(word);
+            }
+            size_t walked = 0;
+            bool complete = forEach(corrupt, [&walked](std::string_view) { ++walked; });
+            CHECK(walked <= corrupt.nodeCount);
+            CHECK(thawSnapshot(corrupt).valueType.has_value() == verifySnapshot(corrupt));
+            return complete && verifySnapshot(corrupt);
+        };
+        auto node = [&valid](size_t index, auto change) {
+            std::string contents = valid;
+            change(reinterpret_cast<SnapshotNode*>(contents.data() + sizeof(SnapshotHeader))[index]);
+            return contents;
+        };
+        auto header = [&valid](auto change) {
+            std::string contents = valid;
+            change(*reinterpret_cast<SnapshotHeader*>(contents.data()));
+            return contents;
+        };
+
+        CHECK(opens(valid));
+        CHECK(verifies(valid));
+        CHECK_FALSE(opens(valid.substr(0, valid.size() - 1)));
+        CHECK_FALSE(opens(header([](SnapshotHeader& h) { h.root = 500; })));
+        CHECK_FALSE(opens(header([](SnapshotHeader& h) { h.nodeCount = UINT64_MAX / 8; })));
+        // Children come first, so a link to the node itself or a later one is a cycle or out of range
+        CHECK_FALSE(verifies(node(10, [](SnapshotNode& n) { n.left = 10; })));
+        CHECK_FALSE(verifies(node(10, [](SnapshotNode& n) { n.right = 499; })));
+        CHECK_FALSE(verifies(node(10, [](SnapshotNode& n) { n.value = 1u << 20; })));
+        CHECK_FALSE(verifies(node(10, [](SnapshotNode& n) { n.length = 1u << 20; })));
+        CHECK_FALSE(verifies(node(10, [](SnapshotNode& n) { n.color = 7; })));
+
+        // A chain is far deeper than any red-black tree of its size
+        std::string chain = valid;
+        auto nodes = reinterpret_cast<SnapshotNode*>(chain.data() + sizeof(SnapshotHeader));
+        for (uint32_t i = 0; i < 500; ++i) {
+            nodes[i].left = i == 0 ? NO_NODE : i - 1;
+            nodes[i].right = NO_NODE;
+        }
+        reinterpret_cast<SnapshotHeader*>(chain.data())->root = 499;
+        CHECK_FALSE(verifies(chain));
+        std::remove(corruptPath);
+    }
+
+    SUBCASE("Empty tree") {
+        const char* emptyPath = "empty_snapshot_test.rbs";
+        REQUIRE(saveSnapshot(RBTree<std::string>())(emptyPath));
+        auto empty = openSnapshot(emptyPath);
+        REQUIRE(empty.valueType.has_value());
+        CHECK_FALSE(snapshotContains(empty.valueType.value())("A"));
+        CHECK(isEmpty(thawSnapshot(empty.valueType.value()).valueType.value()));
+        std::remove(emptyPath);
+    }
+
+    std::remove(filePath);
+}
+
+TEST_CASE("Test multi-version snapshot") {
+    // Every version adds one "chapter" of words to the previous one
+    std::vector<RBTree<std::string>> versions;
+    RBTree<std::string> tree;
+    for (int chapter = 0; chapter < 8; ++chapter) {
+        for (int i = 0; i < 50; ++i) {
+            tree = insert(tree)("W" + std::to_string(chapter) + "_" + std::to_string(i * 37 % 50));
+        }
+        versions.push_back(tree);
+    }
+
+    const char* filePath = "versions_test.rbm";
+    REQUIRE(saveVersions(versions)(filePath));
+
+    auto opened = openVersions(filePath);
+    REQUIRE(opened.valueType.has_value());
+    const TreeVersions& v = opened.valueType.value();
+    REQUIRE(versionCount(v) == versions.size());
+
+    SUBCASE("Shared nodes are written once") {
+        size_t separate = 0;
+        for (const auto& version : versions) {
+            separate += encodeSnapshot(version).size();
+        }
+        CHECK(v.header->nodeCount < 2 * treeSize(versions.back()));
+        CHECK(v.file->size * 2 < separate);
+    }
+
+    SUBCASE("Every version opens on its own") {
+        for (uint32_t i = 0; i < versionCount(v); ++i) {
+            auto snapshot = openVersion(v)(i);
+            REQUIRE(snapshot.valueType.has_value());
+
+            std::vector<std::string> walked;
+            forEach(snapshot.valueType.value(), [&](std::string_view word) { walked.emplace_back(word); });
+            CHECK(walked == treeToVector(versions[i]));
+            CHECK(snapshotContains(snapshot.valueType.value())("W0_0"));
+            CHECK(snapshotContains(snapshot.valueType.value())("W" + std::to_string(i) + "_49"));
+            CHECK_FALSE(snapshotContains(snapshot.valueType.value())("W" + std::to_string(i + 1) + "_0"));
+        }
+        CHECK_FALSE(openVersion(v)(versionCount(v)).valueType.has_value());
+    }
+
+    SUBCASE("Thawed versions share subtrees again") {
+        CHECK(verifyVersions(v));
+        auto thawedVersions = thawVersions(v);
+        REQUIRE(thawedVersions.valueType.has_value());
+        const auto& thawed = thawedVersions.valueType.value();
+        REQUIRE(thawed.size() == versions.size());
+        for (size_t i = 0; i < versions.size(); ++i) {
+            CHECK(encodeSnapshot(thawed[i]) == encodeSnapshot(versions[i]));
+        }
+        // Later chapters sort after earlier ones, so the bottom of the left spine is untouched
+        auto leftmost = [](RBTree<std::string> node) {
+            while (!isEmpty(left(left(node)))) {
+                node = left(node);
+            }
+            return node;
+        };
+        CHECK(leftmost(thawed.back()) == leftmost(thawed[versions.size() - 2]));
+        CHECK(leftmost(versions.back()) == leftmost(versions[versions.size() - 2]));
+    }
+
+    SUBCASE("Single snapshot is not a version file") {
+        const char* singlePath = "single_versions_test.rbs";
+        REQUIRE(saveSnapshot(versions[0])(singlePath));
+        CHECK_FALSE(openVersions(singlePath).valueType.has_value());
+        std::remove(singlePath);
+    }
+
+    SUBCASE("Corrupt roots and links are rejected") {
+        const std::string valid = encodeVersions(versions);
+        const char* corruptPath = "corrupt_versions_test.rbm";
+        size_t nodesAt = sizeof(VersionsHeader) + versions.size() * sizeof(uint32_t);
+        auto opens = [corruptPath](const std::string& contents) {
+            writeBuffer(contents)(corruptPath);
+            return openVersions(corruptPath).valueType.has_value();
+        };
+        // Opening the file only checks the header; a root is checked when its version
+        // is opened, the nodes as they are followed or by verifyVersions
+        auto verifies = [corruptPath](const std::string& contents) {
+            writeBuffer(contents)(corruptPath);
+            auto opened = openVersions(corruptPath);
+            REQUIRE(opened.valueType.has_value());
+            const TreeVersions& corrupt = opened.valueType.value();
+            bool complete = true;
+            for (uint32_t i = 0; i < versionCount(corrupt); ++i) {
+                auto snapshot = openVersion(corrupt)(i);
+                complete = complete && snapshot.valueType.has_value()
+                    && forEach(snapshot.valueType.value(), [](std::string_view) {});
+            }
+            CHECK(thawVersions(corrupt).valueType.has_value() == verifyVersions(corrupt));
+            return complete && verifyVersions(corrupt);
+        };
+        auto changed = [&valid](size_t at, auto change) {
+            std::string contents = valid;
+            change(contents.data() + at);
+            return contents;
+        };
+
+        CHECK(opens(valid));
+        CHECK(verifies(valid));
+        CHECK_FALSE(opens(valid.substr(0, valid.size() - 1)));
+        CHECK_FALSE(opens(changed(0, [](char* h) { reinterpret_cast<VersionsHeader*>(h)->versionCount = UINT32_MAX; })));
+        CHECK_FALSE(opens(changed(0, [](char* h) { reinterpret_cast<VersionsHeader*>(h)->nodeCount = UINT64_MAX / 8; })));
+        std::string badRoot = changed(sizeof(VersionsHeader) + 4, [&v](char* r) { *reinterpret_cast<uint32_t*>(r) = v.header->nodeCount; });
+        CHECK_FALSE(verifies(badRoot));
+        writeBuffer(badRoot)(corruptPath);
+        auto withBadRoot = openVersions(corruptPath);
+        REQUIRE(withBadRoot.valueType.has_value());
+        CHECK(openVersion(withBadRoot.valueType.value())(0).valueType.has_value());
+        CHECK_FALSE(openVersion(withBadRoot.valueType.value())(1).valueType.has_value());
+        CHECK_FALSE(verifies(changed(nodesAt + 20 * sizeof(SnapshotNode), [](char* n) { reinterpret_cast<SnapshotNode*>(n)->left = 20; })));
+        CHECK_FALSE(verifies(changed(nodesAt + 20 * sizeof(SnapshotNode), [](char* n) { reinterpret_cast<SnapshotNode*>(n)->value = 1u << 20; })));
+        std::remove(corruptPath);
+    }
+
+    std::remove(filePath);
+}
+
+TEST_CASE("Test diff function") {
+    std::vector<std::string> words;
+    for (int i = 0; i < 2000; ++i) {
+        words.emplace_back("W" + std::to_string(i * 7919 % 2000));
+    }
+    RBTree<std::string> base = inserted(RBTree<std::string>())(words.begin(), words.end());
+
+    SUBCASE("Same tree") {
+        auto result = diff(base)(base);
+        CHECK(result.added.empty());
+        CHECK(result.removed.empty());
+    }
+
+    SUBCASE("New version of the same tree") {
+        RBTree<std::string> grown = insert(base)("W1000A");
+        grown = insert(grown)("A");
+        grown = insert(grown)("W5");
+
+        auto result = diff(base)(grown);
+        CHECK(result.added == std::vector<std::string>{"A", "W1000A"});
+        CHECK(result.removed.empty());
+
+        auto reverse = diff(grown)(base);
+        CHECK(reverse.removed == std::vector<std::string>{"A", "W1000A"});
+        CHECK(reverse.added.empty());
+    }
+
+    SUBCASE("Unrelated trees with equal content") {
+        std::vector<std::string> reversed(words.rbegin(), words.rend());
+        RBTree<std::string> rebuilt = inserted(RBTree<std::string>())(reversed.begin(), reversed.end());
+        auto result = diff(base)(rebuilt);
+        CHECK(result.added.empty());
+        CHECK(result.removed.empty());
+    }
+
+    SUBCASE("Against empty trees") {
+        auto result = diff(RBTree<std::string>())(base);
+        CHECK(result.added == treeToVector(base));
+        CHECK(diff(base)(RBTree<std::string>()).removed == treeToVector(base));
+    }
+
+    SUBCASE("Disjoint content") {
+        RBTree<std::string> other = insert(RBTree<std::string>())("W1");
+        other = insert(other)("X");
+        auto result = diff(other)(insert(RBTree<std::string>())("W1"));
+        CHECK(result.removed == std::vector<std::string>{"X"});
+        CHECK(result.added.empty());
+    }
+}
+
+/** 
+ * 
+ *  ---------------------------------------- SET ALGEBRA TESTS ----------------------------------
+ * 
+ **/
+
+// Black height of a valid red-black tree, -1 if any invariant is broken
+template<class T>
+int checkRedBlack(const RBTree<T>& t) {
+    if (isEmpty(t)) {
+        return 0;
+    }
+    if (doubledLeft(t) || doubledRight(t)) {
+        return -1;
+    }
+    if ((!isEmpty(left(t)) && !(root(left(t)) < root(t))) || (!isEmpty(right(t)) && !(root(t) < root(right(t))))) {
+        return -1;
+    }
+    int l = checkRedBlack(left(t));
+    int r = checkRedBlack(right(t));
+    if (l < 0 || l != r || blackHeight(t) != l + (rootColor(t) == B ? 1 : 0)) {
+        return -1;
+    }
+    return l + (rootColor(t) == B ? 1 : 0);
+}
+
+TEST_CASE("Test join and split") {
+    std::vector<int> small = {1, 2, 3};
+    std::vector<int> large;
+    for (int i = 10; i < 500; ++i) {
+        large.push_back(i);
+    }
+    RBTree<int> s = inserted(RBTree<int>())(small.begin(), small.end());
+    RBTree<int> l = inserted(RBTree<int>())(large.begin(), large.end());
+
+    SUBCASE("Join trees of different heights") {
+        RBTree<int> joined = join(s, 5, l);
+        CHECK(checkRedBlack(joined) >= 0);
+        CHECK(treeSize(joined) == 494);
+
+        RBTree<int> mirrored = join(l, 1000, insert(RBTree<int>())(1001));
+        CHECK(checkRedBlack(mirrored) >= 0);
+        CHECK(treeSize(mirrored) == 492);
+
+        RBTree<int> onlyRight = join(RBTree<int>(), 0, l);
+        CHECK(checkRedBlack(onlyRight) >= 0);
+        CHECK(treeSize(onlyRight) == 491);
+    }
+
+    SUBCASE("Split keeps both sides valid") {
+        Split<int> parts = split(l, 250);
+        CHECK(parts.found);
+        CHECK(treeSize(parts.less) == 240);
+        CHECK(treeSize(parts.greater) == 249);
+        CHECK(checkRedBlack(parts.less) >= 0);
+        CHECK(checkRedBlack(parts.greater) >= 0);
+        CHECK_FALSE(split(l, 5).found);
+    }
+}
+
+TEST_CASE("Test set algebra") {
+    std::vector<int> evens;
+    std::vector<int> threes;
+    for (int i = 0; i < 30000; ++i) {
+        evens.push_back(i * 2);
+        threes.push_back(i * 3);
+    }
+    RBTree<int> a = inserted(RBTree<int>())(evens.begin(), evens.end());
+    RBTree<int> b = inserted(RBTree<int>())(threes.begin(), threes.end());
+
+    auto elements = [](const RBTree<int>& t) {
+        std::vector<int> result;
+        forEach(t, [&](int x) { result.push_back(x); });
+        return result;
+    };
+    auto expected = [&](auto op) {
+        std::vector<int> result;
+        op(evens.begin(), evens.end(), threes.begin(), threes.end(), std::back_inserter(result));
+        return result;
+    };
+
+    SUBCASE("Union") {
+        RBTree<int> t = unite(a)(b);
+        CHECK(elements(t) == expected([](auto... args) { return std::set_union(args...); }));
+        CHECK(checkRedBlack(t) >= 0);
+    }
+
+    SUBCASE("Intersection") {
+        RBTree<int> t = intersect(a)(b);
+        CHECK(elements(t) == expected([](auto... args) { return std::set_intersection(args...); }));
+        CHECK(checkRedBlack(t) >= 0);
+    }
+
+    SUBCASE("Difference") {
+        RBTree<int> t = difference(a)(b);
+        CHECK(elements(t) == expected([](auto... args) { return std::set_difference(args...); }));
+        CHECK(checkRedBlack(t) >= 0);
+    }
+
+    SUBCASE("Symmetric difference") {
+        RBTree<int> t = symmetricDifference(a)(b);
+        CHECK(elements(t) == expected([](auto... args) { return std::set_symmetric_difference(args...); }));
+        CHECK(checkRedBlack(t) >= 0);
+    }
+
+    SUBCASE("Split threshold follows PARALLEL") {
+        for (size_t threshold : {size_t(2000), SIZE_MAX}) {
+            PARALLEL = {threshold, 0};
+            RBTree<int> t = unite(a)(b);
+            RBTree<int> d = difference(a)(b);
+            PARALLEL = ParallelSettings();
+            CHECK(elements(t) == expected([](auto... args) { return std::set_union(args...); }));
+            CHECK(elements(d) == expected([](auto... args) { return std::set_difference(args...); }));
+        }
+    }
+
+    SUBCASE("Identical versions are reused") {
+        CHECK(intersect(a)(a) == a);
+        CHECK(isEmpty(difference(a)(a)));
+        CHECK(isEmpty(symmetricDifference(a)(a)));
+        CHECK(unite(a)(RBTree<int>()) == a);
+    }
+}
+
+TEST_CASE("Test uniqueWords function") {
+    auto tree = [](std::vector<std::string> words) {
+        return inserted(RBTree<std::string>())(words.begin(), words.end());
+    };
+    auto unique = uniqueWords({tree({"A", "B", "C"}), tree({"B", "D"}), tree({"C", "D", "E"})});
+
+    REQUIRE(unique.size() == 3);
+    CHECK(treeToVector(unique[0]) == std::vector<std::string>{"A"});
+    CHECK(treeToVector(unique[1]).empty());
+    CHECK(treeToVector(unique[2]) == std::vector<std::string>{"E"});
+}
+
+TEST_CASE("Test trimGutenberg function") {
+    SUBCASE("Markers present") {
+        auto result = trimGutenberg("header\n*** START OF THE PROJECT GUTENBERG EBOOK X ***\nbody text\n*** END OF THE PROJECT GUTENBERG EBOOK X ***\nlicense");
+        CHECK(result.valueType.value() == "\nbody text\n");
+    }
+
+    SUBCASE("Older spellings") {
+        auto result = trimGutenberg("***START OF THE PROJECT GUTENBERG EBOOK X***\nbody\nEnd of the Project Gutenberg EBook of X");
+        CHECK(result.valueType.value() == "\nbody\n");
+    }
+
+    SUBCASE("No markers") {
+        CHECK(trimGutenberg("just text").valueType.value() == "just text");
+    }
+}
+
+TEST_CASE("Test corpus loading") {
+    std::filesystem::create_directory("corpus_test");
+    std::ofstream("corpus_test/a.txt") << "*** START OF A ***\nApple banana\n*** END OF A ***\nLICENSE";
+    std::ofstream("corpus_test/b.txt") << "*** START OF B ***\nbanana cherry cherry\n*** END OF B ***";
+    std::ofstream("corpus_test/notes.md") << "not a book";
+    std::ofstream("corpus_list.txt") << "corpus_test/b.txt\n\ncorpus_test/a.txt\n";
+
+    SUBCASE("Directory and list sources") {
+        CHECK(corpusFiles("corpus_test") == std::vector<std::string>{"corpus_test/a.txt", "corpus_test/b.txt"});
+        CHECK(corpusFiles("corpus_list.txt") == std::vector<std::string>{"corpus_test/b.txt", "corpus_test/a.txt"});
+    }
+
+    SUBCASE("Merged and per-book vocabularies") {
+        Corpus corpus = loadCorpus(corpusFiles("corpus_test"))(true);
+        CHECK(treeToVector(corpus.vocabulary) == std::vector<std::string>{"APPLE", "BANANA", "CHERRY"});
+        REQUIRE(corpus.books.size() == 2);
+        CHECK(treeToVector(corpus.books[0]) == std::vector<std::string>{"APPLE", "BANANA"});
+        CHECK(treeToVector(corpus.books[1]) == std::vector<std::string>{"BANANA", "CHERRY"});
+        CHECK(corpus.bytes == std::filesystem::file_size("corpus_test/a.txt") + std::filesystem::file_size("corpus_test/b.txt"));
+    }
+
+    SUBCASE("Every reader yields the same corpus") {
+        for (ReaderKind reader : {ReaderKind::Sync, ReaderKind::Pread, ReaderKind::Uring}) {
+            Corpus corpus = loadCorpus(corpusFiles("corpus_test"))(true, reader, 1);
+            CHECK(treeToVector(corpus.vocabulary) == std::vector<std::string>{"APPLE", "BANANA", "CHERRY"});
+            CHECK(treeToVector(corpus.books[1]) == std::vector<std::string>{"BANANA", "CHERRY"});
+        }
+    }
+
+    SUBCASE("Per-book outputs keep books of the same name apart") {
+        CHECK(bookOutputPaths({"corpus_test/a.txt", "corpus_test/b.txt"}, ".vocab.txt")
+              == std::vector<std::string>{"a.vocab.txt", "b.vocab.txt"});
+        CHECK(bookOutputPaths({"x/a.txt", "b.txt", "y/a.txt"}, ".vocab.txt")
+              == std::vector<std::string>{"a.1.vocab.txt", "b.vocab.txt", "a.3.vocab.txt"});
+    }
+
+    SUBCASE("Books are not kept unless asked for") {
+        Corpus corpus = loadCorpus(corpusFiles("corpus_test"))(false);
+        CHECK(corpus.books.empty());
+        CHECK(treeSize(corpus.vocabulary) == 3);
+    }
+
+    std::filesystem::remove_all("corpus_test");
+    std::remove("corpus_list.txt");
+}
+
+TEST_CASE("Test file readers") {
+    std::vector<std::string> paths;
+    std::string large(3 * (1 << 20) + 17, 'x');
+    std::ofstream("reader_test_large.txt") << large;
+    std::ofstream("reader_test_small.txt") << "small";
+    std::ofstream("reader_test_empty.txt");
+    paths = {"reader_test_large.txt", "reader_test_missing.txt", "reader_test_small.txt", "reader_test_empty.txt"};
+
+    for (ReaderKind reader : {ReaderKind::Sync, ReaderKind::Pread, ReaderKind::Uring}) {
+        FileQueue queue(1);
+        auto reading = std::async(std::launch::async, [&]() {
+            return readFiles(reader, 2)(paths, queue);
+        });
+        std::vector<std::string> texts(paths.size(), "unset");
+        while (auto file = queue.pop()) {
+            texts[file->index] = file->text;
+        }
+        ReaderKind ran = reading.get();
+        CHECK((ran == reader || (reader == ReaderKind::Uring && ran == ReaderKind::Pread)));
+
+        CHECK(texts[0] == large);
+        CHECK(texts[1] == "");
+        CHECK(texts[2] == "small");
+        CHECK(texts[3] == "");
+    }
+
+    for (const auto& path : paths) {
+        std::remove(path.c_str());
+    }
+}
+
+TEST_CASE("Test streaming ingestion") {
+    std::string book = "Title page\n*** START OF THE BOOK ***\nIt's a well-known fact that no-one\nreads the fine print. "
+                       "The well-known END is near\n*** END OF THE BOOK ***\nLicense words here\n";
+    const char* filePath = "stream_test.txt";
+    std::ofstream(filePath) << book << book.substr(0, 11) << "*** START OF TWO ***\nsecond book appears\n*** END OF TWO ***\ntrailer";
+
+    auto expected = textVocabulary(trimGutenberg(book).valueType.value());
+    expected = unite(expected)(textVocabulary("second book appears"));
+
+    SUBCASE("Any chunk size gives the same vocabulary") {
+        for (size_t chunkSize : {1, 2, 3, 7, 16, 64, 4096}) {
+            auto state = streamVocabulary("*** START OF")("*** END OF")(filePath, chunkSize);
+            REQUIRE(state.valueType.has_value());
+            CHECK(treeToVector(state.valueType.value().vocabulary.tree) == treeToVector(expected));
+            CHECK(state.valueType.value().bytes == std::filesystem::file_size(filePath));
+        }
+    }
+
+    SUBCASE("Without markers everything is read") {
+        auto state = streamVocabulary("")("")(filePath, 5);
+        REQUIRE(state.valueType.has_value());
+        auto words = treeToVector(state.valueType.value().vocabulary.tree);
+        CHECK(std::binary_search(words.begin(), words.end(), "TITLE"));
+        CHECK(std::binary_search(words.begin(), words.end(), "LICENSE"));
+        CHECK(std::binary_search(words.begin(), words.end(), "TRAILER"));
+    }
+
+    SUBCASE("A run without whitespace is split at the configured chunk size") {
+        StreamState state;
+        state.endMarker = "*** END OF";
+        state.phase = StreamState::Body;
+        state.chunkSize = 16;
+        size_t longest = 0;
+        for (int i = 0; i < 100; ++i) {
+            state.pending.append(16, 'x');
+            processPending(state, false);
+            longest = std::max(longest, state.pending.size());
+        }
+        CHECK(longest <= 3 * 16 + state.endMarker.size());
+    }
+
+    SUBCASE("Missing file") {
+        CHECK_FALSE(streamVocabulary("")("")("non_existent_file.txt").valueType.has_value());
+    }
+
+    std::remove(filePath);
+}
+
+TEST_CASE("Test spilling to sorted runs") {
+    std::vector<std::string> words;
+    for (int i = 0; i < 3000; ++i) {
+        words.emplace_back("W" + std::to_string(i * 7919 % 2000));
+    }
+    RBTree<std::string> expected = inserted(RBTree<std::string>())(words.begin(), words.end());
+
+    SpillingTree vocabulary;
+    vocabulary.memoryBudget = 20000;
+    for (const auto& word : words) {
+        vocabulary.add(word);
+    }
+
+    REQUIRE(vocabulary.runs.size() > 3);
+    CHECK(treeMemory(vocabulary.tree) <= vocabulary.memoryBudget);
+    auto runs = vocabulary.runs;
+
+    SUBCASE("Merged into text") {
+        const char* textPath = "spill_test.txt";
+        REQUIRE(vocabulary.finish(textPath));
+        writeTree(expected)("spill_expected.txt");
+        CHECK(readFileIntoString(textPath).valueType.value() == readFileIntoString("spill_expected.txt").valueType.value());
+        std::remove(textPath);
+        std::remove("spill_expected.txt");
+    }
+
+    SUBCASE("Merged into the binary vocabulary") {
+        const char* binaryPath = "spill_test.fcv";
+        REQUIRE(vocabulary.finish(binaryPath));
+        CHECK(readFileIntoString(binaryPath).valueType.value() == encodeVocabulary(expected).valueType.value());
+        std::remove(binaryPath);
+    }
+
+    SUBCASE("Front coding streams the index and data") {
+        const char* binaryPath = "spill_streamed.fcv";
+        vocabulary.spill();
+        REQUIRE(mergeRunsIntoFrontCoded(vocabulary.runs)(binaryPath, 64));
+        CHECK(readFileIntoString(binaryPath).valueType.value() == encodeVocabulary(expected).valueType.value());
+        CHECK_FALSE(std::filesystem::exists(std::string(binaryPath) + ".data"));
+        CHECK_FALSE(std::filesystem::exists(std::string(binaryPath) + ".index"));
+        REQUIRE(vocabulary.finish(binaryPath));
+        std::remove(binaryPath);
+    }
+
+    for (const auto& run : runs) {
+        CHECK_FALSE(std::filesystem::exists(run));
+    }
+}
+
+TEST_CASE("Test spilling within one chunk of text") {
+    // Letters only, since filterText drops digits
+    std::string text;
+    std::vector<std::string> words;
+    for (int i = 0; i < 3000; ++i) {
+        std::string word = "W";
+        for (char digit : std::to_string(i * 7919 % 2000)) {
+            word.push_back('A' + (digit - '0'));
+        }
+        words.push_back(word);
+        text += word + " ";
+    }
+    RBTree<std::string> expected = inserted(RBTree<std::string>())(words.begin(), words.end());
+
+    SpillingTree vocabulary;
+    vocabulary.memoryBudget = 20000;
+    insertText(vocabulary, text);
+    CHECK(vocabulary.runs.size() > 3);
+    CHECK(treeMemory(vocabulary.tree) <= vocabulary.memoryBudget);
+    for (const auto& run : vocabulary.runs) {
+        auto contents = readFileIntoString(run);
+        REQUIRE(contents.valueType.has_value());
+        CHECK(contents.valueType.value().size() <= vocabulary.memoryBudget);
+    }
+
+    REQUIRE(vocabulary.finish("spill_chunk_test.txt"));
+    writeTree(expected)("spill_chunk_expected.txt");
+    CHECK(readFileIntoString("spill_chunk_test.txt").valueType.value() == readFileIntoString("spill_chunk_expected.txt").valueType.value());
+    std::remove("spill_chunk_test.txt");
+    std::remove("spill_chunk_expected.txt");
+}
+
+TEST_CASE("Test mergeRuns function") {
+    std::ofstream("merge_run_a.txt") << "APPLE\nCHERRY\nDATE\n";
+    std::ofstream("merge_run_b.txt") << "BANANA\nCHERRY\n";
+    std::ofstream("merge_run_c.txt");
+
+    std::vector<std::string> merged;
+    CHECK(mergeRuns({"merge_run_a.txt", "merge_run_b.txt", "merge_run_c.txt"}, [&](std::string_view word) { merged.emplace_back(word); }));
+    CHECK(merged == std::vector<std::string>{"APPLE", "BANANA", "CHERRY", "DATE"});
+    CHECK_FALSE(mergeRuns({"merge_run_a.txt", "non_existent_run.txt"}, [](std::string_view) {}));
+
+    std::remove("merge_run_a.txt");
+    std::remove("merge_run_b.txt");
+    std::remove("merge_run_c.txt");
+}
+
+TEST_CASE("Test mergeVocabularyFiles function") {
+    std::vector<std::string> paths;
+    std::set<std::string> expected;
+    for (int file = 0; file < 37; ++file) {
+        std::vector<std::string> words;
+        for (int i = 0; i < 50; ++i) {
+            words.push_back("W" + std::to_string((file * 31 + i * 17) % 400));
+        }
+        RBTree<std::string> tree = inserted(RBTree<std::string>())(words.begin(), words.end());
+        paths.push_back("merge_input_" + std::to_string(file) + ".txt");
+        writeTree(tree)(paths.back().c_str());
+        expected.insert(words.begin(), words.end());
+    }
+
+    SUBCASE("Deduplicated") {
+        REQUIRE(mergeVocabularyFiles(paths)("merge_output.txt"));
+        std::string text = readFileIntoString("merge_output.txt").valueType.value();
+        std::string expectedText;
+        for (const auto& word : expected) {
+            expectedText += word + "\n";
+        }
+        CHECK(text == expectedText);
+    }
+
+    SUBCASE("Counts are summed") {
+        std::map<std::string, uint64_t> counts;
+        CHECK(mergeCounts(paths, [&counts](std::string_view word, uint64_t count) { counts[std::string(word)] += count; }));
+        CHECK(counts.size() == expected.size());
+        uint64_t total = 0;
+        for (const auto& [word, count] : counts) {
+            total += count;
+        }
+        CHECK(total == 37 * 50);
+
+        // Counts written out are read back and summed again
+        REQUIRE(mergeVocabularyFiles(paths)("merge_counts.txt", true));
+        REQUIRE(mergeVocabularyFiles({"merge_counts.txt", "merge_counts.txt"})("merge_output.txt", true));
+        std::map<std::string, uint64_t> doubled;
+        mergeCounts({"merge_output.txt"}, [&doubled](std::string_view word, uint64_t count) { doubled[std::string(word)] = count; });
+        for (const auto& [word, count] : counts) {
+            CHECK(doubled[word] == 2 * count);
+        }
+        std::remove("merge_counts.txt");
+    }
+
+    SUBCASE("Single and empty inputs") {
+        std::ofstream("merge_empty.txt");
+        REQUIRE(mergeVocabularyFiles({paths[0], "merge_empty.txt"})("merge_output.txt"));
+        CHECK(readFileIntoString("merge_output.txt").valueType.value() == readFileIntoString(paths[0]).valueType.value());
+        REQUIRE(mergeVocabularyFiles({})("merge_output.txt"));
+        CHECK(readFileIntoString("merge_output.txt").valueType.value().empty());
+        std::remove("merge_empty.txt");
+    }
+
+    for (const auto& path : paths) {
+        std::remove(path.c_str());
+    }
+    std::remove("merge_output.txt");
+}
+
+TEST_CASE("Test ingestAppended function") {
+    const char* feedPath = "incremental_feed.txt";
+    const std::string statePath = "incremental_test";
+    auto ingest = ingestAppended("START")("END");
+    std::remove((statePath + ".rbm").c_str());
+    std::remove((statePath + ".state").c_str());
+    auto vocabulary = [](const IncrementalResult& result) {
+        std::vector<std::string> words;
+        forEach(result.versions.back(), [&words](const std::string& word) { words.push_back(word); });
+        return words;
+    };
+
+    std::ofstream(feedPath) << "Preface START line\nalpha beta gam";
+    auto first = ingest(feedPath, statePath);
+    REQUIRE(first.valueType.has_value());
+    // "gam" may still grow, so it is not a word yet
+    CHECK(vocabulary(first.valueType.value()) == std::vector<std::string>{"ALPHA", "BETA"});
+    CHECK(first.valueType.value().added == std::vector<std::string>{"ALPHA", "BETA"});
+
+    std::ofstream(feedPath, std::ios::app) << "ma alpha delta\n";
+    auto second = ingest(feedPath, statePath);
+    REQUIRE(second.valueType.has_value());
+    CHECK(second.valueType.value().bytes == 15);
+    // The last word stays pending while an end marker could still follow it
+    CHECK(second.valueType.value().added == std::vector<std::string>{"GAMMA"});
+    CHECK(vocabulary(second.valueType.value()) == std::vector<std::string>{"ALPHA", "BETA", "GAMMA"});
+    CHECK(second.valueType.value().versions.size() == 2);
+
+    SUBCASE("Nothing appended") {
+        auto third = ingest(feedPath, statePath);
+        REQUIRE(third.valueType.has_value());
+        CHECK(third.valueType.value().bytes == 0);
+        CHECK(third.valueType.value().added.empty());
+        CHECK(third.valueType.value().versions.size() == 2);
+    }
+
+    SUBCASE("Words after the end marker are skipped") {
+        std::ofstream(feedPath, std::ios::app) << "omega END epsilon\n";
+        auto third = ingest(feedPath, statePath);
+        REQUIRE(third.valueType.has_value());
+        CHECK(third.valueType.value().added == std::vector<std::string>{"DELTA", "OMEGA"});
+        auto versions = openVersions(statePath + ".rbm");
+        REQUIRE(versions.valueType.has_value());
+        CHECK(versionCount(versions.valueType.value()) == 3);
+    }
+
+    SUBCASE("A rewritten file is read again from the start") {
+        std::ofstream(feedPath) << "START\nzeta more text\n";
+        auto third = ingest(feedPath, statePath);
+        REQUIRE(third.valueType.has_value());
+        CHECK(vocabulary(third.valueType.value()) == std::vector<std::string>{"MORE", "ZETA"});
+        CHECK(third.valueType.value().versions.size() == 1);
+    }
+
+    SUBCASE("Only the last versions are kept") {
+        for (const char* word : {"one", "two", "three", "four"}) {
+            std::ofstream(feedPath, std::ios::app) << word << "\n";
+            REQUIRE(ingest(feedPath, statePath, 3).valueType.has_value());
+        }
+        auto versions = openVersions(statePath + ".rbm");
+        REQUIRE(versions.valueType.has_value());
+        CHECK(versionCount(versions.valueType.value()) == 3);
+        auto last = thawVersions(versions.valueType.value()).valueType.value().back();
+        CHECK(treeSize(last) == 7);
+        CHECK(contains(last)(std::string("THREE")));
+    }
+
+    CHECK_FALSE(ingest("non_existent_feed.txt", statePath).valueType.has_value());
+
+    std::remove(feedPath);
+    std::remove((statePath + ".rbm").c_str());
+    std::remove((statePath + ".state").c_str());
+}
+
+TEST_CASE("Test fromSorted function") {
+    for (int n = 0; n < 70; ++n) {
+        std::vector<int> values(n);
+        std::iota(values.begin(), values.end(), 0);
+        RBTree<int> t = fromSorted(values);
+        CHECK(checkRedBlack(t) >= 0);
+        CHECK(treeSize(t) == n);
+        std::vector<int> walked;
+        forEach(t, [&walked](int value) { walked.push_back(value); });
+        CHECK(walked == values);
+    }
+}
+
+TEST_CASE("Test chunk cache") {
+    std::string text;
+    uint32_t seed = 12345;
+    for (int i = 0; i < 20000; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        text += "word" + std::string(1, 'a' + (seed >> 8) % 26) + std::string(1, 'a' + (seed >> 16) % 26) + (seed % 13 == 0 ? "-x'y\n" : " ");
+    }
+    const std::string cacheDirectory = "chunk_cache_test";
+    std::filesystem::remove_all(cacheDirectory);
+
+    SUBCASE("Chunks end after whitespace and cover the text") {
+        auto ends = chunkBoundaries(text);
+        REQUIRE(ends.size() > 5);
+        CHECK(ends.back() == text.size());
+        size_t start = 0;
+        for (size_t end : ends) {
+            CHECK(end - start <= CHUNK_MAX_SIZE);
+            CHECK(isSpace(text[end - 1]));
+            start = end;
+        }
+    }
+
+    SUBCASE("Cached vocabulary equals the direct one") {
+        RBTree<std::string> expected = textVocabulary(text);
+        CachedBook first = cachedVocabulary(cacheDirectory)(text);
+        CHECK(treeToVector(first.vocabulary) == treeToVector(expected));
+        CHECK(first.stats.bytes == text.size());
+        CHECK(first.stats.tokenizedBytes == text.size());
+
+        CachedBook second = cachedVocabulary(cacheDirectory)(text);
+        CHECK(treeToVector(second.vocabulary) == treeToVector(expected));
+        CHECK(second.stats.hits == second.stats.chunks);
+        CHECK(second.stats.tokenizedBytes == 0);
+
+        // An edit in the middle only misses the chunks around it
+        std::string edited = text;
+        edited.insert(text.size() / 2, " inserted preface ");
+        CachedBook third = cachedVocabulary(cacheDirectory)(edited);
+        CHECK(treeToVector(third.vocabulary) == treeToVector(textVocabulary(edited)));
+        CHECK(third.stats.chunks - third.stats.hits <= 2);
+    }
+
+    std::filesystem::remove_all(cacheDirectory);
+}
+
+TEST_CASE("Test stage profiling") {
+    for (int i = 0; i < 3; ++i) {
+        int result = timedStage("test stage")([i](StageTimer& timer) {
+            timer.count(10, 100);
+            return i * 2;
+        });
+        CHECK(result == i * 2);
+    }
+
+    const StageRecord& record = profile().stage("test stage");
+    CHECK(record.calls == 3);
+    CHECK(record.items == 30);
+    CHECK(record.bytes == 300);
+    CHECK(record.milliseconds >= 0);
+    CHECK(profileJson().find("{\"name\": \"test stage\", ") != std::string::npos);
+}
+
+TEST_CASE("Test allocation tracking") {
+    size_t allocations = ALLOCATIONS.allocations;
+    size_t nodeBlocks = NODE_BLOCKS;
+
+    timedStage("allocating stage")([](StageTimer&) {
+        std::vector<int> values(1000);
+        std::vector<int> range(100);
+        std::iota(range.begin(), range.end(), 0);
+        RBTree<int> t = inserted(RBTree<int>())(range.begin(), range.end());
+        CHECK(treeSize(t) == 100);
+        return values.size();
+    });
+
+    const StageRecord& record = profile().stage("allocating stage");
+    CHECK(record.peakRss > 0);
+    CHECK(statusKilobytes("VmHWM:") > 0);
+    CHECK(statusKilobytes("NoSuchField:") == 0);
+
+#ifdef TRACK_ALLOCATIONS
+    CHECK(ALLOCATIONS.allocations - allocations >= 101);
+    CHECK(NODE_BLOCKS - nodeBlocks >= 100);
+    CHECK(record.allocations >= 101);
+    CHECK(record.allocatedBytes >= 1000 * sizeof(int));
+    CHECK(record.nodeBlocks >= 100);
+    // The control block comes on top of every node
+    CHECK(record.nodeBlockBytes > record.nodeBlocks * sizeof(Node<int>));
+    CHECK(record.peakHeap >= 1000 * sizeof(int));
+#else
+    // Without the replaced operators nothing is counted
+    CHECK(ALLOCATIONS.allocations == allocations);
+    CHECK(NODE_BLOCKS == nodeBlocks);
+#endif
+}
+
+TEST_CASE("Test performance counters") {
+    SUBCASE("Some source is always available") {
+        PerfCounters counters;
+        REQUIRE_FALSE(counters.names.empty());
+        CHECK(counters.read().size() == counters.names.size());
+    }
+
+    SUBCASE("Without hardware counters") {
+        PerfCounters counters(false);
+        CHECK(counters.source != CounterSource::Hardware);
+        auto before = counters.read();
+        volatile uint64_t sum = 0;
+        for (uint64_t i = 0; i < 10000000; ++i) {
+            sum = sum + i;
+        }
+        auto after = counters.read();
+        REQUIRE(after.size() == before.size());
+        // task-clock or user time
+        CHECK(after[0] >= before[0]);
+    }
+
+    SUBCASE("Stages record the counters") {
+        const PerfCounters& counters = enablePerfCounters();
+        timedStage("counted stage")([](StageTimer&) {
+            volatile uint64_t sum = 0;
+            for (uint64_t i = 0; i < 1000000; ++i) {
+                sum = sum + i;
+            }
+            return 0;
+        });
+        CHECK(profile().stage("counted stage").counters.size() == counters.names.size());
+        CHECK(profileJson().find("\"counters\": {\"" + counters.names[0]) != std::string::npos);
+        PERF_COUNTERS.reset();
+    }
+}
+
+TEST_CASE("Test tracing parallelInsert") {
+    std::vector<int> values(30000);
+    std::iota(values.begin(), values.end(), 0);
+
+    startTrace();
+    RBTree<int> t = parallelInsert(RBTree<int>())(values.begin(), values.end());
+    stopTrace();
+    CHECK(treeSize(t) == 30000);
+
+    std::map<std::string, int> spans;
+    size_t leafItems = 0;
+    for (const auto& event : TRACE.events) {
+        spans[event.name] += 1;
+        CHECK(event.duration >= 0);
+        if (std::string(event.name) == "inserted") {
+            leafItems += event.items;
+        }
+    }
+    CHECK(spans["inserted"] == 4);
+    CHECK(spans["parallelInsert"] == 3);
+    CHECK(spans["merge"] == 3);
+    CHECK(leafItems == 30000);
+
+    std::string json = traceJson();
+    CHECK(json.find("\"traceEvents\"") != std::string::npos);
+    CHECK(json.find("\"ph\": \"X\"") != std::string::npos);
+
+    // Nothing is recorded while tracing is off
+    parallelInsert(RBTree<int>())(values.begin(), values.end());
+    CHECK(TRACE.events.size() == 10);
+}
+
+TEST_CASE("Test thread scaling settings") {
+    std::vector<std::string> words;
+    for (int i = 0; i < 6000; ++i) {
+        words.push_back(std::to_string(i * 7919 % 5000));
+    }
+    RBTree<std::string> expected = parallelInsert(RBTree<std::string>())(words.begin(), words.end());
+
+    SUBCASE("A thread cap keeps the splits and the result") {
+        for (unsigned threads : {1u, 2u, 3u}) {
+            ScalingPoint point = measureScaling(words)(threads, 1000, 1);
+            CHECK(point.leaves == 8);
+            CHECK(point.runs.size() == 1);
+            CHECK(point.finalMergeMs <= point.mergeMs);
+        }
+        CHECK(PARALLEL.threshold == 10000);
+        CHECK(PARALLEL.threads == 0);
+
+        PARALLEL = {500, 1};
+        RBTree<std::string> capped = parallelInsert(RBTree<std::string>())(words.begin(), words.end());
+        PARALLEL = ParallelSettings();
+        CHECK(treeSize(capped) == 5000);
+        CHECK(diff(expected)(capped).added.empty());
+        CHECK(diff(expected)(capped).removed.empty());
+    }
+
+    SUBCASE("Thread counts double up to the cores") {
+        CHECK(threadCounts(1) == std::vector<unsigned>{1});
+        CHECK(threadCounts(8) == std::vector<unsigned>{1, 2, 4, 8});
+        CHECK(threadCounts(6) == std::vector<unsigned>{1, 2, 4, 6});
+    }
+
+    SUBCASE("Book words are trimmed and filtered like the pipeline's") {
+        auto words = bookWords("header words CHAPTER 1 It's a well-known x truth EPILOGUE\n"
+                               "*** END OF THE PROJECT GUTENBERG EBOOK, WAR AND PEACE ***");
+        CHECK(words == std::vector<std::string>{"IT'S", "A", "WELL-KNOWN", "TRUTH"});
+    }
+}
+
+TEST_CASE("Test contains function") {
+    std::vector<std::string> words = {"WAR", "AND", "PEACE"};
+    RBTree<std::string> t = inserted(RBTree<std::string>())(words.begin(), words.end());
+    CHECK(contains(t)(std::string("PEACE")));
+    CHECK_FALSE(contains(t)(std::string("PIECE")));
+    CHECK_FALSE(contains(RBTree<std::string>())(std::string("WAR")));
+}
+
+TEST_CASE("Test latency histograms") {
+    SUBCASE("Buckets are ordered and percentiles close") {
+        size_t previous = 0;
+        for (uint64_t value = 1; value < 1000000; value = value * 3 / 2 + 1) {
+            size_t index = LatencyHistogram::bucket(value);
+            CHECK(index >= previous);
+            CHECK(LatencyHistogram::highestInBucket(index) >= value);
+            CHECK(LatencyHistogram::highestInBucket(index) <= value + value / LatencyHistogram::SUB_BUCKETS);
+            previous = index;
+        }
+        CHECK(LatencyHistogram::bucket(UINT64_MAX) < LatencyHistogram::BUCKETS);
+
+        LatencyHistogram histogram;
+        for (uint64_t value = 1; value <= 100000; ++value) {
+            histogram.record(value);
+        }
+        CHECK(histogram.count() == 100000);
+        CHECK(histogram.percentile(0.5) == doctest::Approx(50000).epsilon(0.04));
+        CHECK(histogram.percentile(0.99) == doctest::Approx(99000).epsilon(0.04));
+        CHECK(histogram.percentile(1.0) == 100000);
+
+        LatencyHistogram other;
+        other.record(5000000);
+        histogram.merge(other);
+        CHECK(histogram.count() == 100001);
+        CHECK(histogram.max() == 5000000);
+    }
+
+    SUBCASE("Operations are recorded per thread and merged") {
+        resetLatencies();
+        recordLatencies(true);
+        std::vector<int> values(20000);
+        std::iota(values.begin(), values.end(), 0);
+        RBTree<int> t = parallelInsert(RBTree<int>())(values.begin(), values.end());
+        CHECK(contains(t)(4242));
+        recordLatencies(false);
+
+        LatencyHistogram inserts = mergedLatencies(Operation::Insert);
+        // Both leaves and the merge insert 10000 values each
+        CHECK(inserts.count() == 30000);
+        CHECK(mergedLatencies(Operation::Merge).count() == 1);
+        CHECK(mergedLatencies(Operation::Lookup).count() == 1);
+        CHECK(inserts.percentile(0.5) <= inserts.percentile(0.999));
+
+        contains(t)(1);
+        CHECK(mergedLatencies(Operation::Lookup).count() == 1);
+        resetLatencies();
+    }
+}
+
+TEST_CASE("Test Zipf sampler and keys") {
+    SUBCASE("Low ranks come up most, in proportion to 1 / rank") {
+        ZipfSampler sampler(1000);
+        std::mt19937_64 engine(7);
+        std::vector<size_t> counts(1000);
+        for (int i = 0; i < 100000; ++i) {
+            ++counts[sampler(engine)];
+        }
+        CHECK(counts[0] > counts[1]);
+        CHECK(counts[1] > counts[9]);
+        CHECK(counts[0] == doctest::Approx(2.0 * counts[1]).epsilon(0.1));
+        CHECK(std::accumulate(counts.begin(), counts.end(), size_t{0}) == 100000);
+    }
+
+    SUBCASE("Keys are distinct, upper case and of the given length") {
+        std::set<std::string> keys;
+        for (uint64_t rank = 0; rank < 20000; ++rank) {
+            std::string key = zipfKey(rank, 8);
+            CHECK(key.size() == 8);
+            CHECK(std::all_of(key.begin(), key.end(), [](char c) { return c >= 'A' && c <= 'Z'; }));
+            keys.insert(key);
+        }
+        CHECK(keys.size() == 20000);
+        CHECK(zipfKey(42, 32) == zipfKey(42, 32));
+        CHECK(zipfKey(30, 1).size() == 2);
+    }
+}
@@ -2,7 +2,7 @@
 
 mkdir testBuild
 pushd testBuild
-wsl g++ -std=c++20 ../test.cpp -o test
+wsl g++ -std=c++20 -DTRACK_ALLOCATIONS ../test.cpp ../Memory.cpp -o test
 popd testBuild
 
 wsl ./testBuild/test
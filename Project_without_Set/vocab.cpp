@@ -0,0 +1,119 @@
+#include "Vocabulary.h"
+#include "Automaton.h"
+#include "Snapshot.h"
+#include "Merge.h"
+#include <cstring>
+
+// vocab pack <output.txt> <output.fcv>
+// vocab unpack <output.fcv> <output.txt>
+// vocab lookup <output.fcv> <word>...
+// vocab dawg <output.txt> <output.dawg>
+// vocab prefix <output.dawg> <prefix>
+// vocab sizes <output.txt>
+// vocab tree <tree.rbs> <word>...
+// vocab merge [--counts] <merged.txt> <output.txt | @list file>...
+int main(int argc, char* argv[]) {
+    if (argc >= 4 && std::strcmp(argv[1], "pack") == 0) {
+        return packVocabulary(argv[2])(argv[3]) ? 0 : 1;
+    }
+    if (argc >= 4 && std::strcmp(argv[1], "unpack") == 0) {
+        return unpackVocabulary(argv[2])(argv[3]) ? 0 : 1;
+    }
+    if (argc >= 3 && std::strcmp(argv[1], "lookup") == 0) {
+        auto vocabulary = openVocabulary(argv[2]);
+        if (!vocabulary.valueType.has_value()) {
+            std::cerr << "\nCould not open vocabulary\n";
+            return 1;
+        }
+        for (int i = 3; i < argc; ++i) {
+            bool found = containsWord(vocabulary.valueType.value())(str_toupper(std::string(argv[i])));
+            std::cout << argv[i] << (found ? ": yes" : ": no") << std::endl;
+        }
+        return 0;
+    }
+
+    if (argc >= 4 && std::strcmp(argv[1], "dawg") == 0) {
+        return buildAutomaton(argv[2])(argv[3]) ? 0 : 1;
+    }
+    if (argc >= 4 && std::strcmp(argv[1], "prefix") == 0) {
+        auto automaton = openAutomaton(argv[2]);
+        if (!automaton.valueType.has_value()) {
+            std::cerr << "\nCould not open automaton\n";
+            return 1;
+        }
+        forEachWithPrefix(automaton.valueType.value(), str_toupper(std::string(argv[3])), [](std::string_view word) {
+            std::cout << word << '\n';
+        });
+        return 0;
+    }
+    if (argc >= 3 && std::strcmp(argv[1], "sizes") == 0) {
+        std::string text = argv[2];
+        if (!packVocabulary(text)((text + ".fcv").c_str()) || !buildAutomaton(text)((text + ".dawg").c_str())) {
+            std::cerr << "\nCould not convert " << text << "\n";
+            return 1;
+        }
+        auto report = [&text](const char* name, const std::string& path) {
+            auto size = mapFile(path)->size;
+            std::cout << name << size << " bytes (" << 100.0 * size / mapFile(text)->size << "%)" << std::endl;
+        };
+        report("text: ", text);
+        report("fcv:  ", text + ".fcv");
+        report("dawg: ", text + ".dawg");
+        std::remove((text + ".fcv").c_str());
+        std::remove((text + ".dawg").c_str());
+        return 0;
+    }
+
+    if (argc >= 3 && std::strcmp(argv[1], "tree") == 0) {
+        auto snapshot = openSnapshot(argv[2]);
+        if (!snapshot.valueType.has_value()) {
+            std::cerr << "\nCould not open snapshot\n";
+            return 1;
+        }
+        for (int i = 3; i < argc; ++i) {
+            bool found = snapshotContains(snapshot.valueType.value())(str_toupper(std::string(argv[i])));
+            std::cout << argv[i] << (found ? ": yes" : ": no") << std::endl;
+        }
+        return 0;
+    }
+    if (argc >= 3 && std::strcmp(argv[1], "merge") == 0) {
+        bool withCounts = std::strcmp(argv[2], "--counts") == 0;
+        int first = withCounts ? 3 : 2;
+        if (argc < first + 2) {
+            std::cerr << "\nNothing to merge\n";
+            return 1;
+        }
+
+        // @file names a file with one input path per line
+        std::vector<std::string> inputs;
+        for (int i = first + 1; i < argc; ++i) {
+            if (argv[i][0] != '@') {
+                inputs.emplace_back(argv[i]);
+                continue;
+            }
+            std::ifstream list(argv[i] + 1);
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty()) {
+                    inputs.push_back(line);
+                }
+            }
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!mergeVocabularyFiles(inputs)(argv[first], withCounts)) {
+            std::cerr << "\nCould not merge vocabularies\n";
+            return 1;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        size_t bytes = 0;
+        for (const auto& input : inputs) {
+            bytes += mapFile(input)->size;
+        }
+        std::cout << inputs.size() << " files, " << bytes / (1024.0 * 1024.0) / seconds << " MB/s" << std::endl;
+        return 0;
+    }
+
+    std::cerr << "usage: vocab pack|unpack|dawg <in> <out> | lookup <file.fcv> <word>... | prefix <file.dawg> <prefix> | sizes <output.txt> | tree <tree.rbs> <word>... | merge [--counts] <out> <in>...\n";
+    return 1;
+}
@@ -0,0 +1,6 @@
+@echo off
+
+mkdir buildG++
+pushd buildG++
+wsl g++ -std=c++20 ../vocab.cpp -o vocab -O2
+popd buildG++